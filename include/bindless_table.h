@@ -0,0 +1,175 @@
+#ifndef BINDLESS_TABLE_H__
+#define BINDLESS_TABLE_H__
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <vector>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+#include "d3dx12.h"
+#include "descriptor_allocator.h"
+
+const UINT BINDLESS_CAPACITY = 1024;
+const UINT BINDLESS_REGISTER_SPACE = 1;
+
+// Tier 2 allows at most this many UAVs in a descriptor table, only tier 3 takes an unbounded UAV range.
+const UINT BINDLESS_TIER_2_UAV_COUNT = 64;
+
+// Every texture and buffer gets a stable slot in one block of the shader-visible heap.
+// The block is bound once per command list as an unbounded SRV and UAV array, draws only
+// pass slot indices as root constants:
+//
+//     Texture2D<float4> textures[] : register(t0, space1);
+//     RWByteAddressBuffer buffers[] : register(u0, space1);
+//
+// Needs resource binding tier 2, see supported(). On tier 2 the UAV range only covers the first
+// BINDLESS_TIER_2_UAV_COUNT slots. Those are kept for UAVs, every one of them must hold a valid UAV
+// so free ones hold null UAVs, and SRVs are allocated above them.
+class BindlessTable
+{
+public:
+	static D3D12_RESOURCE_BINDING_TIER bindingTier(ID3D12Device* device) noexcept
+	{
+		D3D12_FEATURE_DATA_D3D12_OPTIONS options{};
+		if (FAILED(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)))) return D3D12_RESOURCE_BINDING_TIER_1;
+		return options.ResourceBindingTier;
+	}
+
+	static bool supported(ID3D12Device* device) noexcept
+	{
+		return bindingTier(device) >= D3D12_RESOURCE_BINDING_TIER_2;
+	}
+
+	static UINT uavCount(D3D12_RESOURCE_BINDING_TIER tier) noexcept
+	{
+		return tier >= D3D12_RESOURCE_BINDING_TIER_3 ? UINT_MAX : BINDLESS_TIER_2_UAV_COUNT;
+	}
+
+	// Overlapping SRV and UAV ranges over the same descriptors, for a root descriptor table. The SRV
+	// range is unbounded, the UAV range too from tier 3 on. Slots may be empty, so descriptors are volatile.
+	static void initRanges(CD3DX12_DESCRIPTOR_RANGE1 (&ranges)[2], D3D12_RESOURCE_BINDING_TIER tier) noexcept
+	{
+		ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT_MAX, 0, BINDLESS_REGISTER_SPACE, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE, 0);
+		ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, uavCount(tier), 0, BINDLESS_REGISTER_SPACE, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE | D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE, 0);
+	}
+
+	void create(ID3D12Device* device, ShaderVisibleDescriptorHeap* heap, UINT capacity = BINDLESS_CAPACITY)
+	{
+		m_device.copy_from(device);
+		m_table = heap->allocateStatic(capacity);
+		m_descriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+		// An unbounded UAV range shares every slot with the SRVs.
+		const UINT uavs = uavCount(bindingTier(device));
+		m_uavSlots = uavs == UINT_MAX ? 0 : (std::min)(uavs, capacity);
+
+		m_freeSlots.clear();
+		for (UINT i = capacity; i-- > m_uavSlots;)
+		{
+			m_freeSlots.push_back(i);
+		}
+		m_freeUavSlots.clear();
+		for (UINT i = m_uavSlots; i-- > 0;)
+		{
+			m_freeUavSlots.push_back(i);
+			clearUav(i);
+		}
+		m_retired.clear();
+	}
+
+	void destroy() noexcept
+	{
+		m_freeSlots.clear();
+		m_freeUavSlots.clear();
+		m_retired.clear();
+		m_device = nullptr;
+	}
+
+	// Bind with SetGraphicsRootDescriptorTable / SetComputeRootDescriptorTable.
+	D3D12_GPU_DESCRIPTOR_HANDLE gpuBase() const noexcept { return m_table.gpu; }
+
+	UINT addSrv(ID3D12Resource* resource, const D3D12_SHADER_RESOURCE_VIEW_DESC* desc)
+	{
+		const UINT slot = allocateSlot(m_freeSlots, "Bindless table full");
+		m_device->CreateShaderResourceView(resource, desc, cpuHandle(slot));
+		return slot;
+	}
+
+	UINT addUav(ID3D12Resource* resource, const D3D12_UNORDERED_ACCESS_VIEW_DESC* desc)
+	{
+		const UINT slot = m_uavSlots > 0 ? allocateSlot(m_freeUavSlots, "Bindless table has no free slot in the UAV range") : allocateSlot(m_freeSlots, "Bindless table full");
+		m_device->CreateUnorderedAccessView(resource, nullptr, desc, cpuHandle(slot));
+		return slot;
+	}
+
+	// The slot is reused once fenceValue has completed, frames in flight may still index it.
+	void remove(UINT slot, UINT64 fenceValue)
+	{
+		m_retired.push_back({ slot, fenceValue });
+	}
+
+	void collect(UINT64 completedValue)
+	{
+		while (!m_retired.empty() && m_retired.front().fenceValue <= completedValue)
+		{
+			const UINT slot = m_retired.front().slot;
+			if (slot < m_uavSlots)
+			{
+				// The released resource's view may not stay in the bounded UAV range.
+				clearUav(slot);
+				m_freeUavSlots.push_back(slot);
+			}
+			else
+			{
+				m_freeSlots.push_back(slot);
+			}
+			m_retired.pop_front();
+		}
+	}
+
+private:
+	struct Retired
+	{
+		UINT	slot;
+		UINT64	fenceValue;
+	};
+
+	// Slots are taken from the back, where create() puts the lowest ones.
+	static UINT allocateSlot(std::vector<UINT>& freeSlots, const char* error)
+	{
+		if (freeSlots.empty()) throw std::runtime_error(error);
+
+		const UINT slot = freeSlots.back();
+		freeSlots.pop_back();
+		return slot;
+	}
+
+	// A null view typed like the shader's RWByteAddressBuffer array.
+	void clearUav(UINT slot)
+	{
+		D3D12_UNORDERED_ACCESS_VIEW_DESC desc{};
+		desc.Format = DXGI_FORMAT_R32_TYPELESS;
+		desc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+		desc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
+		m_device->CreateUnorderedAccessView(nullptr, nullptr, &desc, cpuHandle(slot));
+	}
+
+	D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle(UINT slot) const noexcept
+	{
+		return CD3DX12_CPU_DESCRIPTOR_HANDLE(m_table.cpu, static_cast<INT>(slot), m_descriptorSize);
+	}
+
+	winrt::com_ptr<ID3D12Device>	m_device;
+	DescriptorTable					m_table;
+	UINT							m_descriptorSize = 0;
+	UINT							m_uavSlots = 0;			// Slots [0, m_uavSlots) only take UAVs
+	std::vector<UINT>				m_freeSlots;
+	std::vector<UINT>				m_freeUavSlots;
+	std::deque<Retired>				m_retired;
+};
+
+#endif // BINDLESS_TABLE_H__
@@ -0,0 +1,165 @@
+#ifndef COMMAND_ALLOCATOR_POOL_H__
+#define COMMAND_ALLOCATOR_POOL_H__
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+// An allocator keeps the memory of the largest recording it has held across Reset().
+// One that held more commands than this is destroyed once the GPU is done with it instead of reused.
+const UINT64 COMMAND_ALLOCATOR_TRIM_COMMANDS = 65536;
+
+// Command allocators by queue type, recycled once the fence value they were released with has completed.
+// A frame takes as many allocators as it records lists concurrently instead of one fixed slot per frame.
+//
+// D3D12 does not report allocator memory, so callers report the number of commands they recorded
+// on release and the pool keeps each allocator's high-water mark as its size. Fence values of one
+// queue type must come from one timeline. acquire() and release() may be called from any thread.
+class CommandAllocatorPool
+{
+public:
+	void create(ID3D12Device* device, UINT64 trimCommands = COMMAND_ALLOCATOR_TRIM_COMMANDS)
+	{
+		m_device.copy_from(device);
+		m_trimCommands = trimCommands;
+		m_created = 0;
+		m_trimmed = 0;
+		m_peakCommands = 0;
+	}
+
+	// The GPU must be idle or gone, allocators still in flight are released too.
+	void destroy() noexcept
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queues.clear();
+		m_inUse.clear();
+		m_device = nullptr;
+	}
+
+	// A reset allocator of type. Reuses the oldest released one whose fence value has completed
+	// and creates a new one when none has.
+	ID3D12CommandAllocator* acquire(D3D12_COMMAND_LIST_TYPE type, UINT64 completedValue)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::deque<Entry>& released = m_queues[type];
+		while (!released.empty() && released.front().fenceValue <= completedValue)
+		{
+			Entry entry = std::move(released.front());
+			released.pop_front();
+			if (entry.commands > m_trimCommands)
+			{
+				m_trimmed++;
+				continue;
+			}
+
+			winrt::check_hresult(entry.allocator->Reset());
+			ID3D12CommandAllocator* allocator = entry.allocator.get();
+			m_inUse.emplace(allocator, std::move(entry));
+			return allocator;
+		}
+
+		Entry entry;
+		entry.type = type;
+		winrt::check_hresult(m_device->CreateCommandAllocator(type, IID_ID3D12CommandAllocator, entry.allocator.put_void()));
+		m_created++;
+
+		ID3D12CommandAllocator* allocator = entry.allocator.get();
+		m_inUse.emplace(allocator, std::move(entry));
+		return allocator;
+	}
+
+	// Hand an allocator back after its lists are submitted. fenceValue is the value that retires them,
+	// commands roughly how many were recorded into it since acquire().
+	void release(ID3D12CommandAllocator* allocator, UINT64 fenceValue, UINT64 commands = 0)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_inUse.find(allocator);
+		if (it == m_inUse.end()) return;
+
+		Entry entry = std::move(it->second);
+		m_inUse.erase(it);
+		entry.fenceValue = fenceValue;
+		entry.commands = (std::max)(entry.commands, commands);
+		m_peakCommands = (std::max)(m_peakCommands, entry.commands);
+		m_queues[entry.type].push_back(std::move(entry));
+	}
+
+	UINT created() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_created;
+	}
+
+	UINT trimmed() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_trimmed;
+	}
+
+	UINT64 peakCommands() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_peakCommands;
+	}
+
+	UINT inUse() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return static_cast<UINT>(m_inUse.size());
+	}
+
+	UINT released() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		size_t count = 0;
+		for (const auto& [type, queue] : m_queues)
+		{
+			count += queue.size();
+		}
+		return static_cast<UINT>(count);
+	}
+
+	// Sum of every live allocator's high-water mark, the memory the pool holds on to.
+	UINT64 retainedCommands() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		UINT64 commands = 0;
+		for (const auto& [allocator, entry] : m_inUse)
+		{
+			commands += entry.commands;
+		}
+		for (const auto& [type, queue] : m_queues)
+		{
+			for (const Entry& entry : queue)
+			{
+				commands += entry.commands;
+			}
+		}
+		return commands;
+	}
+
+private:
+	struct Entry
+	{
+		winrt::com_ptr<ID3D12CommandAllocator>	allocator;
+		D3D12_COMMAND_LIST_TYPE					type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+		UINT64									fenceValue = 0;
+		UINT64									commands = 0;
+	};
+
+	winrt::com_ptr<ID3D12Device>									m_device;
+	UINT64															m_trimCommands = COMMAND_ALLOCATOR_TRIM_COMMANDS;
+	mutable std::mutex												m_mutex;
+	std::unordered_map<D3D12_COMMAND_LIST_TYPE, std::deque<Entry>>	m_queues;
+	std::unordered_map<ID3D12CommandAllocator*, Entry>				m_inUse;
+	UINT															m_created = 0;
+	UINT															m_trimmed = 0;
+	UINT64															m_peakCommands = 0;
+};
+
+#endif // COMMAND_ALLOCATOR_POOL_H__
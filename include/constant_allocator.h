@@ -0,0 +1,100 @@
+#ifndef CONSTANT_ALLOCATOR_H__
+#define CONSTANT_ALLOCATOR_H__
+
+#include <cstring>
+#include <stdexcept>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+#include "d3dx12.h"
+#include "frame_ring.h"
+
+// Enough for ~16k uniquely parameterized draws per frame.
+const UINT64 CONSTANT_BYTES_PER_FRAME = 4 * 1024 * 1024;
+
+struct ConstantAllocation
+{
+	UINT8*						cpuAddress = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS	gpuAddress = 0;
+	UINT						size = 0;
+};
+
+// Per-frame bump allocator over one persistently mapped UPLOAD buffer.
+// Each frame ring slot owns a region which is rewound in beginFrame(), after the ring has
+// waited for that slot, so allocations never need their own fence bookkeeping.
+class ConstantAllocator
+{
+public:
+	void create(ID3D12Device* device, UINT frameCount, UINT64 bytesPerFrame = CONSTANT_BYTES_PER_FRAME)
+	{
+		m_bytesPerFrame = (bytesPerFrame + D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1) & ~UINT64(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1);
+		m_frameBase = 0;
+		m_offset = 0;
+
+		winrt::check_hresult(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(m_bytesPerFrame * frameCount),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_ID3D12Resource,
+			m_buffer.put_void()
+		));
+
+		CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
+		winrt::check_hresult(m_buffer->Map(0, &readRange, reinterpret_cast<void**>(&m_cpuAddress)));
+		m_gpuAddress = m_buffer->GetGPUVirtualAddress();
+	}
+
+	void destroy() noexcept
+	{
+		m_buffer = nullptr;
+		m_cpuAddress = nullptr;
+		m_gpuAddress = 0;
+	}
+
+	void beginFrame(UINT frameIndex) noexcept
+	{
+		m_frameBase = m_bytesPerFrame * frameIndex;
+		m_offset = 0;
+	}
+
+	// Returns a 256-byte aligned slice that is valid for the current frame only.
+	ConstantAllocation allocate(UINT size)
+	{
+		const UINT alignedSize = (size + D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1) & ~(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1);
+		if (m_offset + alignedSize > m_bytesPerFrame)
+		{
+			throw std::runtime_error("Constant allocator exhausted for this frame");
+		}
+
+		ConstantAllocation allocation;
+		allocation.cpuAddress = m_cpuAddress + m_frameBase + m_offset;
+		allocation.gpuAddress = m_gpuAddress + m_frameBase + m_offset;
+		allocation.size = alignedSize;
+		m_offset += alignedSize;
+		return allocation;
+	}
+
+	// Copy data in and return the address to bind, e.g. with SetGraphicsRootConstantBufferView.
+	template<typename T>
+	D3D12_GPU_VIRTUAL_ADDRESS push(const T& data)
+	{
+		ConstantAllocation allocation = allocate(static_cast<UINT>(sizeof(T)));
+		memcpy(allocation.cpuAddress, &data, sizeof(T));
+		return allocation.gpuAddress;
+	}
+
+private:
+	winrt::com_ptr<ID3D12Resource>	m_buffer;
+	UINT8*							m_cpuAddress = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS		m_gpuAddress = 0;
+
+	UINT64							m_bytesPerFrame = 0;
+	UINT64							m_frameBase = 0;
+	UINT64							m_offset = 0;
+};
+
+#endif // CONSTANT_ALLOCATOR_H__
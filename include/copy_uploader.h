@@ -0,0 +1,205 @@
+#ifndef COPY_UPLOADER_H__
+#define COPY_UPLOADER_H__
+
+#include <cstring>
+#include <vector>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+#include "d3dx12.h"
+#include "fast_memcpy.h"
+#include "footprint_cache.h"
+#include "frame_ring.h"
+#include "upload_ring.h"
+
+const UINT COPY_UPLOADER_BATCHES = 2;
+
+struct TextureUpload
+{
+	ID3D12Resource*					destination = nullptr;
+	const D3D12_RESOURCE_DESC*		desc = nullptr;			// Optional, saves a GetDesc() call
+	UINT							firstSubresource = 0;
+	UINT							numSubresources = 1;
+	const D3D12_SUBRESOURCE_DATA*	data = nullptr;
+};
+
+// Asynchronous upload service on its own COPY queue, with its own allocators, fence and staging ring.
+// Uploads are recorded into an open batch and submitted without the CPU waiting for them;
+// each returns a ticket on the copy timeline that the consumer waits on at first use.
+//
+// Destinations must be created in D3D12_RESOURCE_STATE_COMMON. The copy promotes them to
+// COPY_DEST and they decay back to COMMON afterwards, from where buffers and textures are
+// implicitly promoted to the read states they are used in on the direct queue.
+class CopyUploader
+{
+public:
+	void create(ID3D12Device* device, UINT64 stagingSize = UPLOAD_RING_SIZE)
+	{
+		D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+		queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+		queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+		winrt::check_hresult(device->CreateCommandQueue(&queueDesc, IID_ID3D12CommandQueue, m_commandQueue.put_void()));
+
+		m_ring.create(device, m_commandQueue.get(), COPY_UPLOADER_BATCHES, D3D12_COMMAND_LIST_TYPE_COPY);
+		m_staging.create(device, &m_ring, stagingSize);
+		m_footprints.create(device);
+		m_copyWorkers.create();
+
+		winrt::check_hresult(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, m_ring.frame(0).commandAllocator.get(), nullptr, IID_ID3D12CommandList, m_commandList.put_void()));
+		winrt::check_hresult(m_commandList->Close());
+		m_open = false;
+	}
+
+	void destroy() noexcept
+	{
+		m_ring.waitForGpu();
+		m_commandList = nullptr;
+		m_staging.destroy();
+		m_footprints.destroy();
+		m_copyWorkers.destroy();
+		m_ring.destroy();
+		m_commandQueue = nullptr;
+		m_open = false;
+	}
+
+	ID3D12CommandQueue* queue() const noexcept { return m_commandQueue.get(); }
+
+	// Record a texture upload, returns the ticket of the batch it lands in.
+	UINT64 uploadTexture(ID3D12Resource* destination, UINT firstSubresource, UINT numSubresources, const D3D12_SUBRESOURCE_DATA* data)
+	{
+		TextureUpload upload;
+		upload.destination = destination;
+		upload.firstSubresource = firstSubresource;
+		upload.numSubresources = numSubresources;
+		upload.data = data;
+		return uploadTextures(&upload, 1);
+	}
+
+	// Record many uploads with one staging allocation into the mapped ring and one pass of copy commands.
+	// Footprints come from the cache, so same-shaped resources cost no device calls after the first.
+	UINT64 uploadTextures(const TextureUpload* uploads, UINT count)
+	{
+		open();
+
+		// Lay every upload out back to back in a single staging range.
+		m_batch.resize(count);
+		UINT64 batchSize = 0;
+		for (UINT i = 0; i < count; i++)
+		{
+			const D3D12_RESOURCE_DESC desc = uploads[i].desc ? *uploads[i].desc : uploads[i].destination->GetDesc();
+			m_batch[i].footprints = &m_footprints.get(desc, uploads[i].firstSubresource, uploads[i].numSubresources);
+			m_batch[i].buffer = desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER;
+
+			batchSize = (batchSize + D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1) & ~UINT64(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1);
+			m_batch[i].offset = batchSize;
+			batchSize += m_batch[i].footprints->totalBytes;
+		}
+		if (batchSize == 0) return m_ring.pendingValue();
+
+		UploadAllocation staging = m_staging.allocate(batchSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+
+		for (UINT i = 0; i < count; i++)
+		{
+			const SubresourceFootprints& footprints = *m_batch[i].footprints;
+			for (UINT s = 0; s < uploads[i].numSubresources; s++)
+			{
+				const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout = footprints.layouts[s];
+				D3D12_MEMCPY_DEST destData = { staging.cpuAddress + m_batch[i].offset + layout.Offset, layout.Footprint.RowPitch, SIZE_T(layout.Footprint.RowPitch) * SIZE_T(footprints.numRows[s]) };
+				MemcpySubresourceFast(&destData, &uploads[i].data[s], static_cast<SIZE_T>(footprints.rowSizesInBytes[s]), footprints.numRows[s], layout.Footprint.Depth, &m_copyWorkers);
+			}
+		}
+
+		for (UINT i = 0; i < count; i++)
+		{
+			const SubresourceFootprints& footprints = *m_batch[i].footprints;
+			const UINT64 base = staging.offset + m_batch[i].offset;
+			if (m_batch[i].buffer)
+			{
+				m_commandList->CopyBufferRegion(uploads[i].destination, 0, staging.resource, base + footprints.layouts[0].Offset, footprints.layouts[0].Footprint.Width);
+				continue;
+			}
+
+			for (UINT s = 0; s < uploads[i].numSubresources; s++)
+			{
+				D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout = footprints.layouts[s];
+				layout.Offset += base;
+
+				const CD3DX12_TEXTURE_COPY_LOCATION dst(uploads[i].destination, uploads[i].firstSubresource + s);
+				const CD3DX12_TEXTURE_COPY_LOCATION src(staging.resource, layout);
+				m_commandList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+			}
+		}
+		return m_ring.pendingValue();
+	}
+
+	// Record a buffer upload, returns the ticket of the batch it lands in.
+	UINT64 uploadBuffer(ID3D12Resource* destination, UINT64 destinationOffset, const void* data, UINT64 size)
+	{
+		open();
+
+		UploadAllocation staging = m_staging.allocate(size, 4);
+		memcpy(staging.cpuAddress, data, size);
+		m_commandList->CopyBufferRegion(destination, destinationOffset, staging.resource, staging.offset, size);
+		return m_ring.pendingValue();
+	}
+
+	// Kick off everything recorded so far. Never waits unless every batch slot is still in flight.
+	UINT64 submit()
+	{
+		if (!m_open) return m_ring.pendingValue() - 1;
+
+		winrt::check_hresult(m_commandList->Close());
+		ID3D12CommandList* cmdLists[] = { m_commandList.get() };
+		m_commandQueue->ExecuteCommandLists(1, cmdLists);
+		m_open = false;
+
+		const UINT64 ticket = m_ring.endFrame();
+		m_staging.retire(ticket);
+		return ticket;
+	}
+
+	bool isComplete(UINT64 ticket) noexcept { return m_ring.isComplete(ticket); }
+
+	// GPU-side wait: work submitted to queue afterwards will not start before the upload lands.
+	// Skipped entirely once the ticket has completed, so steady-state frames pay nothing.
+	void waitOnQueue(ID3D12CommandQueue* queue, UINT64 ticket)
+	{
+		if (isComplete(ticket)) return;
+
+		winrt::check_hresult(queue->Wait(m_ring.fence(), ticket));
+	}
+
+private:
+	struct BatchEntry
+	{
+		const SubresourceFootprints*	footprints = nullptr;
+		UINT64							offset = 0;
+		bool							buffer = false;
+	};
+
+	void open()
+	{
+		if (m_open) return;
+
+		// Move to the next batch slot and reclaim staging memory of finished batches.
+		FrameContext& batch = m_ring.beginFrame((m_ring.frameIndex() + 1) % m_ring.frameCount());
+		m_staging.collect(m_ring.completedValue());
+
+		winrt::check_hresult(batch.commandAllocator->Reset());
+		winrt::check_hresult(m_commandList->Reset(batch.commandAllocator.get(), nullptr));
+		m_open = true;
+	}
+
+	winrt::com_ptr<ID3D12CommandQueue>			m_commandQueue;
+	winrt::com_ptr<ID3D12GraphicsCommandList>	m_commandList;
+	FrameRing									m_ring;
+	UploadRing									m_staging;
+	FootprintCache								m_footprints;
+	CopyWorkers									m_copyWorkers;
+	std::vector<BatchEntry>						m_batch;
+	bool										m_open = false;
+};
+
+#endif // COPY_UPLOADER_H__
@@ -0,0 +1,78 @@
+#ifndef DEFERRED_RELEASE_H__
+#define DEFERRED_RELEASE_H__
+
+#include <deque>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <winrt/base.h>
+
+// Holds the last reference to resources, heaps and allocators until the fence value
+// of their last use has completed, instead of flushing the GPU before dropping them.
+class DeferredReleaseQueue
+{
+public:
+	// Called with every object as it is retired, so caches keyed on it can drop their entries.
+	using RetireListener = std::function<void(::IUnknown* object)>;
+
+	void listen(const void* owner, RetireListener listener)
+	{
+		m_listeners.emplace_back(owner, std::move(listener));
+	}
+
+	void unlisten(const void* owner) noexcept
+	{
+		for (size_t i = m_listeners.size(); i-- > 0;)
+		{
+			if (m_listeners[i].first == owner) m_listeners.erase(m_listeners.begin() + i);
+		}
+	}
+
+	// Take ownership of object; it is released once fenceValue completes.
+	template<typename T>
+	void retire(winrt::com_ptr<T>& object, UINT64 fenceValue)
+	{
+		if (!object) return;
+
+		for (const auto& [owner, listener] : m_listeners)
+		{
+			listener(object.get());
+		}
+
+		Entry entry;
+		entry.fenceValue = fenceValue;
+		entry.object.attach(object.detach());
+		m_entries.push_back(std::move(entry));
+	}
+
+	// Release everything whose fence value has completed.
+	// Retirement values are taken from one monotonic timeline, so the queue stays sorted.
+	void collect(UINT64 completedValue) noexcept
+	{
+		while (!m_entries.empty() && m_entries.front().fenceValue <= completedValue)
+		{
+			m_entries.pop_front();
+		}
+	}
+
+	// Drop everything, only valid once the GPU is idle or the device is gone.
+	void flush() noexcept
+	{
+		m_entries.clear();
+	}
+
+	size_t size() const noexcept { return m_entries.size(); }
+
+private:
+	struct Entry
+	{
+		winrt::com_ptr<::IUnknown>	object;
+		UINT64						fenceValue = 0;
+	};
+
+	std::deque<Entry>										m_entries;
+	std::vector<std::pair<const void*, RetireListener>>		m_listeners;
+};
+
+#endif // DEFERRED_RELEASE_H__
@@ -0,0 +1,220 @@
+#ifndef DESCRIPTOR_ALLOCATOR_H__
+#define DESCRIPTOR_ALLOCATOR_H__
+
+#include <stdexcept>
+#include <vector>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+#include "d3dx12.h"
+
+const UINT STAGING_DESCRIPTORS_PER_PAGE = 1024;
+const UINT SHADER_VISIBLE_STATIC_DESCRIPTORS = 4096;
+const UINT SHADER_VISIBLE_DESCRIPTORS_PER_FRAME = 16384;
+
+// A persistent CPU-only descriptor, the source for CopyDescriptors.
+struct DescriptorHandle
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE	cpu{};
+	UINT						index = UINT(-1);
+
+	bool valid() const noexcept { return index != UINT(-1); }
+};
+
+// A contiguous range in the shader-visible heap.
+struct DescriptorTable
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE	cpu{};
+	D3D12_GPU_DESCRIPTOR_HANDLE	gpu{};
+	UINT						count = 0;
+};
+
+// CPU-only descriptor heap that grows by pages and recycles slots through a free list.
+// Views are created here once and copied into the shader-visible heap when they are bound.
+class StagingDescriptorHeap
+{
+public:
+	void create(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type)
+	{
+		m_device.copy_from(device);
+		m_type = type;
+		m_descriptorSize = device->GetDescriptorHandleIncrementSize(type);
+		m_pages.clear();
+		m_freeList.clear();
+	}
+
+	void destroy() noexcept
+	{
+		m_pages.clear();
+		m_freeList.clear();
+		m_device = nullptr;
+	}
+
+	DescriptorHandle allocate()
+	{
+		if (m_freeList.empty())
+		{
+			addPage();
+		}
+
+		DescriptorHandle handle;
+		handle.index = m_freeList.back();
+		m_freeList.pop_back();
+
+		const UINT page = handle.index / STAGING_DESCRIPTORS_PER_PAGE;
+		const UINT slot = handle.index % STAGING_DESCRIPTORS_PER_PAGE;
+		handle.cpu = CD3DX12_CPU_DESCRIPTOR_HANDLE(m_pages[page]->GetCPUDescriptorHandleForHeapStart(), static_cast<INT>(slot), m_descriptorSize);
+		return handle;
+	}
+
+	// Safe right away, shader-visible copies do not reference the staging slot.
+	void free(DescriptorHandle& handle)
+	{
+		if (!handle.valid()) return;
+
+		m_freeList.push_back(handle.index);
+		handle = {};
+	}
+
+	UINT descriptorSize() const noexcept { return m_descriptorSize; }
+
+private:
+	void addPage()
+	{
+		D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+		heapDesc.NumDescriptors = STAGING_DESCRIPTORS_PER_PAGE;
+		heapDesc.Type = m_type;
+		heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+
+		winrt::com_ptr<ID3D12DescriptorHeap> page;
+		winrt::check_hresult(m_device->CreateDescriptorHeap(&heapDesc, IID_ID3D12DescriptorHeap, page.put_void()));
+		m_pages.push_back(page);
+
+		// Hand out low indices first.
+		const UINT base = static_cast<UINT>(m_pages.size() - 1) * STAGING_DESCRIPTORS_PER_PAGE;
+		for (UINT i = STAGING_DESCRIPTORS_PER_PAGE; i-- > 0;)
+		{
+			m_freeList.push_back(base + i);
+		}
+	}
+
+	winrt::com_ptr<ID3D12Device>						m_device;
+	D3D12_DESCRIPTOR_HEAP_TYPE							m_type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	UINT												m_descriptorSize = 0;
+	std::vector<winrt::com_ptr<ID3D12DescriptorHeap>>	m_pages;
+	std::vector<UINT>									m_freeList;
+};
+
+// One large shader-visible CBV/SRV/UAV heap, bound once per command list.
+// [0, staticCount) holds descriptors that live as long as their resource,
+// the rest is split into one linear ring region per frame slot for per-frame tables.
+class ShaderVisibleDescriptorHeap
+{
+public:
+	void create(ID3D12Device* device, UINT frameCount, UINT staticCount = SHADER_VISIBLE_STATIC_DESCRIPTORS, UINT perFrameCount = SHADER_VISIBLE_DESCRIPTORS_PER_FRAME)
+	{
+		m_device.copy_from(device);
+		m_staticCount = staticCount;
+		m_staticUsed = 0;
+		m_perFrameCount = perFrameCount;
+		m_frameBase = staticCount;
+		m_frameUsed = 0;
+
+		D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+		heapDesc.NumDescriptors = staticCount + perFrameCount * frameCount;
+		heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+		heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+		winrt::check_hresult(device->CreateDescriptorHeap(&heapDesc, IID_ID3D12DescriptorHeap, m_heap.put_void()));
+
+		m_descriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		m_cpuStart = m_heap->GetCPUDescriptorHandleForHeapStart();
+		m_gpuStart = m_heap->GetGPUDescriptorHandleForHeapStart();
+	}
+
+	void destroy() noexcept
+	{
+		m_heap = nullptr;
+		m_device = nullptr;
+	}
+
+	ID3D12DescriptorHeap* heap() const noexcept { return m_heap.get(); }
+
+	// Descriptors that are written once, e.g. the SRV of a texture loaded at startup.
+	DescriptorTable allocateStatic(UINT count)
+	{
+		if (m_staticUsed + count > m_staticCount)
+		{
+			throw std::runtime_error("Static descriptor region exhausted");
+		}
+
+		DescriptorTable table = tableAt(m_staticUsed, count);
+		m_staticUsed += count;
+		return table;
+	}
+
+	// Rewind this frame slot's ring region, called once the frame ring has waited for the slot.
+	void beginFrame(UINT frameIndex) noexcept
+	{
+		m_frameBase = m_staticCount + m_perFrameCount * frameIndex;
+		m_frameUsed = 0;
+	}
+
+	// A table valid for the current frame only.
+	DescriptorTable allocateFrame(UINT count)
+	{
+		if (m_frameUsed + count > m_perFrameCount)
+		{
+			throw std::runtime_error("Per-frame descriptor region exhausted");
+		}
+
+		DescriptorTable table = tableAt(m_frameBase + m_frameUsed, count);
+		m_frameUsed += count;
+		return table;
+	}
+
+	// Gather staging descriptors into a contiguous per-frame table and return where to bind it.
+	D3D12_GPU_DESCRIPTOR_HANDLE stageTable(const DescriptorHandle* handles, UINT count)
+	{
+		DescriptorTable table = allocateFrame(count);
+
+		m_sources.resize(count);
+		m_sourceSizes.assign(count, 1);
+		for (UINT i = 0; i < count; i++)
+		{
+			m_sources[i] = handles[i].cpu;
+		}
+
+		const UINT destinationSize = count;
+		m_device->CopyDescriptors(1, &table.cpu, &destinationSize, count, m_sources.data(), m_sourceSizes.data(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		return table.gpu;
+	}
+
+private:
+	DescriptorTable tableAt(UINT index, UINT count) const noexcept
+	{
+		DescriptorTable table;
+		table.cpu = CD3DX12_CPU_DESCRIPTOR_HANDLE(m_cpuStart, static_cast<INT>(index), m_descriptorSize);
+		table.gpu = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_gpuStart, static_cast<INT>(index), m_descriptorSize);
+		table.count = count;
+		return table;
+	}
+
+	winrt::com_ptr<ID3D12Device>			m_device;
+	winrt::com_ptr<ID3D12DescriptorHeap>	m_heap;
+	UINT									m_descriptorSize = 0;
+	D3D12_CPU_DESCRIPTOR_HANDLE				m_cpuStart{};
+	D3D12_GPU_DESCRIPTOR_HANDLE				m_gpuStart{};
+
+	UINT									m_staticCount = 0;
+	UINT									m_staticUsed = 0;
+	UINT									m_perFrameCount = 0;
+	UINT									m_frameBase = 0;
+	UINT									m_frameUsed = 0;
+
+	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>	m_sources;
+	std::vector<UINT>							m_sourceSizes;
+};
+
+#endif // DESCRIPTOR_ALLOCATOR_H__
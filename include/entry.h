@@ -1,6 +1,8 @@
 #ifndef ENTRY_H__
 #define ENTRY_H__
 
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <string>
 
@@ -9,10 +11,37 @@
 
 GLFWwindow* g_pWindow;
 
+// Size draw() renders at, only touched by the thread calling draw(). It picks up the window size
+// before each frame and calls on_size() there when it changed.
 int gWidth{ 0 };
 int gHeight{ 0 };
 
-int run();
+// Window size as GLFW last reported it on the main thread, width and height packed so they change together
+std::atomic<uint64_t> gWindowSize{ 0 };
+
+// Depth of the frame ring, --frames-in-flight N (2-4)
+int gFramesInFlight{ 2 };
+
+// update() runs on its own thread at this fixed step unless --serial is given
+const double SIMULATION_STEP{ 1.0 / 60.0 };
+bool gSerial{ false };
+std::atomic<bool> gRunning{ false };
+
+// --headless [N] renders N frames offscreen without a window, --warp uses the software adapter
+bool gHeadless{ false };
+int gHeadlessFrames{ 300 };
+bool gWarp{ false };
+
+// Called at the end of a headless run after the frame times, samples set it to print their own statistics
+void (*gHeadlessReport)(){ nullptr };
+
+// --memory-budget MB caps video memory below the adapter budget, 0 keeps the adapter budget
+int gMemoryBudgetMB{ 0 };
+
+// --draws N records N draws per frame, split across one command list per hardware thread
+int gDrawCount{ 1 };
+
+int run(int argc, char** argv);
 
 bool init();
 void update();
@@ -0,0 +1,256 @@
+#ifndef FAST_MEMCPY_H__
+#define FAST_MEMCPY_H__
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <immintrin.h>
+
+#include <d3d12.h>
+
+#include "d3dx12.h"
+
+// Below this many bytes a copy stays on the calling thread.
+const SIZE_T FAST_COPY_PARALLEL_THRESHOLD = 4 * 1024 * 1024;
+
+// Upper bound on worker threads per copy, write-combined memory saturates long before core count.
+const UINT FAST_COPY_MAX_WORKERS = 4;
+
+// Copy with non-temporal stores so the destination (usually write-combined UPLOAD memory)
+// never passes through the cache. Call _mm_sfence() before handing the memory to the GPU.
+inline void streamCopy(void* dest, const void* src, SIZE_T size) noexcept
+{
+#if defined(__AVX2__)
+	const SIZE_T VECTOR_SIZE = 32;
+#else
+	const SIZE_T VECTOR_SIZE = 16;
+#endif
+
+	auto d = static_cast<BYTE*>(dest);
+	auto s = static_cast<const BYTE*>(src);
+
+	// Streaming stores need an aligned destination, copy the head normally.
+	const SIZE_T head = (std::min)(size, (VECTOR_SIZE - (reinterpret_cast<uintptr_t>(d) & (VECTOR_SIZE - 1))) & (VECTOR_SIZE - 1));
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	size -= head;
+
+	// Four vectors per iteration to keep the write-combining buffers full.
+	while (size >= VECTOR_SIZE * 4)
+	{
+#if defined(__AVX2__)
+		const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+		const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 32));
+		const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 64));
+		const __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 96));
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(d), a);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(d + 32), b);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(d + 64), c);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(d + 96), e);
+#else
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16));
+		const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 32));
+		const __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 48));
+		_mm_stream_si128(reinterpret_cast<__m128i*>(d), a);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(d + 16), b);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(d + 32), c);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(d + 48), e);
+#endif
+		d += VECTOR_SIZE * 4;
+		s += VECTOR_SIZE * 4;
+		size -= VECTOR_SIZE * 4;
+	}
+
+	memcpy(d, s, size);
+}
+
+// Threads for large copies, started once and reused by every copy instead of spawned per call.
+// Whoever issues the copies owns one, see CopyUploader. One copy runs at a time.
+class CopyWorkers
+{
+public:
+	~CopyWorkers()
+	{
+		destroy();
+	}
+
+	// threadCount 0 uses up to FAST_COPY_MAX_WORKERS hardware threads, the one calling run() included.
+	void create(UINT threadCount = 0)
+	{
+		if (threadCount == 0)
+		{
+			threadCount = (std::min)((std::max)(std::thread::hardware_concurrency(), 1U), FAST_COPY_MAX_WORKERS);
+		}
+
+		m_stopping = false;
+		m_generation = 0;
+		for (UINT i = 1; i < threadCount; i++)
+		{
+			m_workers.emplace_back([this, i]() { work(i); });
+		}
+	}
+
+	void destroy() noexcept
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_wake.notify_all();
+		for (std::thread& worker : m_workers)
+		{
+			worker.join();
+		}
+		m_workers.clear();
+	}
+
+	// Run copy(begin, end) over [0, count), split across as many threads as the size warrants.
+	// Every thread fences its streaming stores before this returns.
+	template<typename Copy>
+	void run(UINT count, SIZE_T totalBytes, Copy&& copy)
+	{
+		const UINT threads = static_cast<UINT>((std::min)({
+			m_workers.size() + 1,
+			static_cast<SIZE_T>(count),
+			totalBytes / FAST_COPY_PARALLEL_THRESHOLD + 1
+		}));
+
+		if (threads <= 1)
+		{
+			copy(0U, count);
+			_mm_sfence();
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_copy = [&copy](UINT begin, UINT end) { copy(begin, end); };
+			m_count = count;
+			m_threads = threads;
+			m_remaining = threads - 1;
+			m_generation++;
+		}
+		m_wake.notify_all();
+
+		copyRange(0);
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this]() { return m_remaining == 0; });
+		m_copy = nullptr;
+	}
+
+private:
+	void work(UINT index)
+	{
+		UINT64 generation = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [this, generation]() { return m_stopping || m_generation != generation; });
+				if (m_stopping) return;
+				generation = m_generation;
+				if (index >= m_threads) continue;
+			}
+
+			copyRange(index);
+
+			bool last = false;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				last = --m_remaining == 0;
+			}
+			if (last) m_done.notify_one();
+		}
+	}
+
+	void copyRange(UINT index)
+	{
+		const UINT perThread = (m_count + m_threads - 1) / m_threads;
+		const UINT begin = (std::min)(m_count, perThread * index);
+		const UINT end = (std::min)(m_count, begin + perThread);
+		if (begin < end) m_copy(begin, end);
+		_mm_sfence();
+	}
+
+	std::vector<std::thread>				m_workers;
+	std::mutex								m_mutex;
+	std::condition_variable					m_wake;
+	std::condition_variable					m_done;
+	bool									m_stopping = false;
+	UINT64									m_generation = 0;
+	UINT									m_remaining = 0;
+	UINT									m_count = 0;
+	UINT									m_threads = 0;
+	std::function<void(UINT, UINT)>			m_copy;
+};
+
+// copy(begin, end) over [0, count) on workers, or all of it on the calling thread without them.
+template<typename Copy>
+void parallelCopy(CopyWorkers* workers, UINT count, SIZE_T totalBytes, Copy&& copy)
+{
+	if (workers)
+	{
+		workers->run(count, totalBytes, copy);
+		return;
+	}
+
+	copy(0U, count);
+	_mm_sfence();
+}
+
+// Drop-in replacement for MemcpySubresource in d3dx12.h for large subresources.
+// Tightly packed source and destination are copied as one block, otherwise rows are split across workers.
+inline void MemcpySubresourceFast(
+	const D3D12_MEMCPY_DEST* pDest,
+	const D3D12_SUBRESOURCE_DATA* pSrc,
+	SIZE_T RowSizeInBytes,
+	UINT NumRows,
+	UINT NumSlices,
+	CopyWorkers* workers = nullptr)
+{
+	const SIZE_T totalBytes = RowSizeInBytes * NumRows * NumSlices;
+	auto pDestBase = static_cast<BYTE*>(pDest->pData);
+	auto pSrcBase = static_cast<const BYTE*>(pSrc->pData);
+
+	const bool contiguous =
+		pDest->RowPitch == RowSizeInBytes && static_cast<SIZE_T>(pSrc->RowPitch) == RowSizeInBytes &&
+		(NumSlices == 1 || (pDest->SlicePitch == RowSizeInBytes * NumRows && static_cast<SIZE_T>(pSrc->SlicePitch) == RowSizeInBytes * NumRows));
+
+	if (contiguous)
+	{
+		// Split the block into 64KB chunks, never a row layout to worry about.
+		const SIZE_T CHUNK_SIZE = 64 * 1024;
+		const UINT chunkCount = static_cast<UINT>((totalBytes + CHUNK_SIZE - 1) / CHUNK_SIZE);
+		parallelCopy(workers, chunkCount, totalBytes, [&](UINT begin, UINT end)
+		{
+			const SIZE_T offset = CHUNK_SIZE * begin;
+			streamCopy(pDestBase + offset, pSrcBase + offset, (std::min)(totalBytes, CHUNK_SIZE * end) - offset);
+		});
+		return;
+	}
+
+	const UINT rowCount = NumRows * NumSlices;
+	parallelCopy(workers, rowCount, totalBytes, [&](UINT begin, UINT end)
+	{
+		for (UINT row = begin; row < end; row++)
+		{
+			const UINT z = row / NumRows;
+			const UINT y = row % NumRows;
+			streamCopy(
+				pDestBase + pDest->SlicePitch * z + pDest->RowPitch * y,
+				pSrcBase + pSrc->SlicePitch * LONG_PTR(z) + pSrc->RowPitch * LONG_PTR(y),
+				RowSizeInBytes);
+		}
+	});
+}
+
+#endif // FAST_MEMCPY_H__
@@ -0,0 +1,113 @@
+#ifndef FOOTPRINT_CACHE_H__
+#define FOOTPRINT_CACHE_H__
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+// Copyable footprints of a subresource range, laid out from offset 0.
+struct SubresourceFootprints
+{
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>	layouts;
+	std::vector<UINT>								numRows;
+	std::vector<UINT64>								rowSizesInBytes;
+	UINT64											totalBytes = 0;
+};
+
+// GetCopyableFootprints results keyed by resource description, so uploading many textures
+// of the same shape asks the device once instead of once per texture.
+class FootprintCache
+{
+public:
+	void create(ID3D12Device* device)
+	{
+		m_device.copy_from(device);
+		m_footprints.clear();
+	}
+
+	void destroy() noexcept
+	{
+		m_footprints.clear();
+		m_device = nullptr;
+	}
+
+	const SubresourceFootprints& get(const D3D12_RESOURCE_DESC& desc, UINT firstSubresource, UINT numSubresources)
+	{
+		const Key key{ desc, firstSubresource, numSubresources };
+		auto it = m_footprints.find(key);
+		if (it != m_footprints.end()) return it->second;
+
+		SubresourceFootprints& footprints = m_footprints[key];
+		footprints.layouts.resize(numSubresources);
+		footprints.numRows.resize(numSubresources);
+		footprints.rowSizesInBytes.resize(numSubresources);
+		m_device->GetCopyableFootprints(
+			&desc,
+			firstSubresource,
+			numSubresources,
+			0,
+			footprints.layouts.data(),
+			footprints.numRows.data(),
+			footprints.rowSizesInBytes.data(),
+			&footprints.totalBytes
+		);
+		return footprints;
+	}
+
+	size_t size() const noexcept { return m_footprints.size(); }
+
+private:
+	struct Key
+	{
+		D3D12_RESOURCE_DESC	desc;
+		UINT				firstSubresource;
+		UINT				numSubresources;
+
+		// Field by field, the description has padding after Dimension.
+		bool operator==(const Key& other) const noexcept
+		{
+			return
+				desc.Dimension == other.desc.Dimension &&
+				desc.Alignment == other.desc.Alignment &&
+				desc.Width == other.desc.Width &&
+				desc.Height == other.desc.Height &&
+				desc.DepthOrArraySize == other.desc.DepthOrArraySize &&
+				desc.MipLevels == other.desc.MipLevels &&
+				desc.Format == other.desc.Format &&
+				desc.SampleDesc.Count == other.desc.SampleDesc.Count &&
+				desc.SampleDesc.Quality == other.desc.SampleDesc.Quality &&
+				desc.Layout == other.desc.Layout &&
+				desc.Flags == other.desc.Flags &&
+				firstSubresource == other.firstSubresource &&
+				numSubresources == other.numSubresources;
+		}
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const noexcept
+		{
+			size_t hash = 0;
+			auto combine = [&hash](UINT64 value) { hash ^= std::hash<UINT64>()(value) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2); };
+			combine(key.desc.Dimension);
+			combine(key.desc.Alignment);
+			combine(key.desc.Width);
+			combine(key.desc.Height);
+			combine((UINT64(key.desc.DepthOrArraySize) << 16) | key.desc.MipLevels);
+			combine(key.desc.Format);
+			combine((UINT64(key.desc.SampleDesc.Count) << 32) | key.desc.SampleDesc.Quality);
+			combine((UINT64(key.desc.Layout) << 32) | key.desc.Flags);
+			combine((UINT64(key.firstSubresource) << 32) | key.numSubresources);
+			return hash;
+		}
+	};
+
+	winrt::com_ptr<ID3D12Device>							m_device;
+	std::unordered_map<Key, SubresourceFootprints, KeyHash>	m_footprints;
+};
+
+#endif // FOOTPRINT_CACHE_H__
@@ -0,0 +1,156 @@
+#ifndef FRAME_RING_H__
+#define FRAME_RING_H__
+
+#include <algorithm>
+#include <system_error>
+
+#include <Windows.h>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+// Depth of the frame ring is chosen at startup (see gFramesInFlight), these are the bounds.
+const UINT MIN_FRAMES_IN_FLIGHT = 2;
+const UINT MAX_FRAMES_IN_FLIGHT = 4;
+
+// Everything a frame slot owns until the GPU has finished with it.
+struct FrameContext
+{
+	winrt::com_ptr<ID3D12CommandAllocator>	commandAllocator;
+
+	// Value on the ring timeline signaled after this slot's last submission.
+	UINT64									fenceValue = 0;
+};
+
+// Frame context ring on a single monotonically increasing fence timeline.
+// Every submission point (end of frame or a full flush) signals the next value,
+// so anything stamped with a value can be recycled once the fence passes it.
+class FrameRing
+{
+public:
+	void create(ID3D12Device* device, ID3D12CommandQueue* commandQueue, UINT frameCount, D3D12_COMMAND_LIST_TYPE type = D3D12_COMMAND_LIST_TYPE_DIRECT)
+	{
+		m_frameCount = std::clamp(frameCount, MIN_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT);
+		m_frameIndex = 0;
+		m_commandQueue.copy_from(commandQueue);
+
+		for (UINT i = 0; i < m_frameCount; i++)
+		{
+			winrt::check_hresult(device->CreateCommandAllocator(type, IID_ID3D12CommandAllocator, m_frames[i].commandAllocator.put_void()));
+			m_frames[i].fenceValue = 0;
+		}
+
+		m_nextFenceValue = 1;
+		m_completedFenceValue = 0;
+		winrt::check_hresult(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_ID3D12Fence, m_fence.put_void()));
+
+		m_fenceEvent.attach(CreateEventEx(nullptr, nullptr, 0, EVENT_MODIFY_STATE | SYNCHRONIZE));
+		if (!m_fenceEvent)
+		{
+			throw std::system_error(std::error_code(static_cast<int>(GetLastError()), std::system_category()), "CreateEventEx");
+		}
+	}
+
+	void destroy() noexcept
+	{
+		for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		{
+			m_frames[i] = {};
+		}
+
+		m_fence = nullptr;
+		m_commandQueue = nullptr;
+		m_fenceEvent.close();
+	}
+
+	UINT frameCount() const noexcept { return m_frameCount; }
+	UINT frameIndex() const noexcept { return m_frameIndex; }
+
+	FrameContext& current() noexcept { return m_frames[m_frameIndex]; }
+	FrameContext& frame(UINT index) noexcept { return m_frames[index]; }
+
+	ID3D12Fence* fence() const noexcept { return m_fence.get(); }
+
+	// The value the next signal will write, i.e. the value that retires work recorded now.
+	UINT64 pendingValue() const noexcept { return m_nextFenceValue; }
+
+	UINT64 completedValue() noexcept
+	{
+		if (m_fence)
+		{
+			m_completedFenceValue = (std::max)(m_completedFenceValue, m_fence->GetCompletedValue());
+		}
+		return m_completedFenceValue;
+	}
+
+	bool isComplete(UINT64 fenceValue) noexcept
+	{
+		return fenceValue <= m_completedFenceValue || fenceValue <= completedValue();
+	}
+
+	// Schedule a Signal command in the queue and return the value it will write.
+	UINT64 signal()
+	{
+		const UINT64 fenceValue = m_nextFenceValue;
+		winrt::check_hresult(m_commandQueue->Signal(m_fence.get(), fenceValue));
+		m_nextFenceValue++;
+		return fenceValue;
+	}
+
+	// Block the CPU until the GPU has reached fenceValue.
+	void wait(UINT64 fenceValue)
+	{
+		if (isComplete(fenceValue)) return;
+
+		winrt::check_hresult(m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent.get()));
+		WaitForSingleObjectEx(m_fenceEvent.get(), INFINITE, FALSE);
+		m_completedFenceValue = (std::max)(m_completedFenceValue, fenceValue);
+	}
+
+	// Wait until all previous GPU work is complete.
+	void waitForGpu() noexcept
+	{
+		if (m_commandQueue && m_fence && m_fenceEvent)
+		{
+			const UINT64 fenceValue = m_nextFenceValue;
+			if (SUCCEEDED(m_commandQueue->Signal(m_fence.get(), fenceValue)))
+			{
+				m_nextFenceValue++;
+				if (SUCCEEDED(m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent.get())))
+				{
+					WaitForSingleObjectEx(m_fenceEvent.get(), INFINITE, FALSE);
+					m_completedFenceValue = fenceValue;
+				}
+			}
+		}
+	}
+
+	// Make frameIndex the current slot, waiting if the GPU still uses it.
+	FrameContext& beginFrame(UINT frameIndex)
+	{
+		m_frameIndex = frameIndex;
+		wait(m_frames[m_frameIndex].fenceValue);
+		return m_frames[m_frameIndex];
+	}
+
+	// Stamp the current slot with a new timeline value.
+	UINT64 endFrame()
+	{
+		m_frames[m_frameIndex].fenceValue = signal();
+		return m_frames[m_frameIndex].fenceValue;
+	}
+
+private:
+	FrameContext							m_frames[MAX_FRAMES_IN_FLIGHT];
+	UINT									m_frameCount = MIN_FRAMES_IN_FLIGHT;
+	UINT									m_frameIndex = 0;
+
+	winrt::com_ptr<ID3D12CommandQueue>		m_commandQueue;
+	winrt::com_ptr<ID3D12Fence>				m_fence;
+	winrt::handle							m_fenceEvent;
+	UINT64									m_nextFenceValue = 1;
+	UINT64									m_completedFenceValue = 0;
+};
+
+#endif // FRAME_RING_H__
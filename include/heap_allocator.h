@@ -0,0 +1,420 @@
+#ifndef HEAP_ALLOCATOR_H__
+#define HEAP_ALLOCATOR_H__
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+#include "d3dx12.h"
+#include "residency_manager.h"
+
+// A pool's first heap block is this size, or the first request's if larger. Each block after it
+// doubles the previous one up to HEAP_MAX_BLOCK_SIZE, larger requests get a block of their own size.
+const UINT64 HEAP_MIN_BLOCK_SIZE = 1024 * 1024;
+const UINT64 HEAP_MAX_BLOCK_SIZE = 32 * 1024 * 1024;
+
+// Power-of-two buddy allocator over [0, size). Blocks are naturally aligned to their size,
+// so any alignment up to the block size comes for free.
+class BuddyAllocator
+{
+public:
+	void init(UINT64 size, UINT64 minBlockSize)
+	{
+		m_minBlockSize = minBlockSize;
+		m_orderCount = 1;
+		while ((m_minBlockSize << (m_orderCount - 1)) < size) m_orderCount++;
+		m_size = m_minBlockSize << (m_orderCount - 1);
+
+		m_freeBlocks.assign(m_orderCount, {});
+		m_freeBlocks[m_orderCount - 1].insert(0);
+		m_allocated.clear();
+		m_usedBytes = 0;
+		m_requestedBytes = 0;
+	}
+
+	bool allocate(UINT64 size, UINT64 alignment, UINT64& offset)
+	{
+		const UINT order = orderFor((std::max)(size, alignment));
+		if (order >= m_orderCount) return false;
+
+		// Smallest free block that fits, split down to the requested order.
+		UINT found = order;
+		while (found < m_orderCount && m_freeBlocks[found].empty()) found++;
+		if (found == m_orderCount) return false;
+
+		offset = *m_freeBlocks[found].begin();
+		m_freeBlocks[found].erase(m_freeBlocks[found].begin());
+		while (found > order)
+		{
+			found--;
+			m_freeBlocks[found].insert(offset + blockSize(found));
+		}
+
+		m_allocated[offset] = { order, size };
+		m_usedBytes += blockSize(order);
+		m_requestedBytes += size;
+		return true;
+	}
+
+	void free(UINT64 offset)
+	{
+		auto it = m_allocated.find(offset);
+		if (it == m_allocated.end()) return;
+
+		UINT order = it->second.order;
+		m_usedBytes -= blockSize(order);
+		m_requestedBytes -= it->second.size;
+		m_allocated.erase(it);
+
+		// Merge with the buddy for as long as it is free too.
+		while (order + 1 < m_orderCount)
+		{
+			const UINT64 buddy = offset ^ blockSize(order);
+			auto buddyIt = m_freeBlocks[order].find(buddy);
+			if (buddyIt == m_freeBlocks[order].end()) break;
+
+			m_freeBlocks[order].erase(buddyIt);
+			offset = (std::min)(offset, buddy);
+			order++;
+		}
+		m_freeBlocks[order].insert(offset);
+	}
+
+	bool empty() const noexcept { return m_allocated.empty(); }
+
+	UINT64 size() const noexcept { return m_size; }
+	UINT64 usedBytes() const noexcept { return m_usedBytes; }
+	UINT64 requestedBytes() const noexcept { return m_requestedBytes; }
+
+	UINT64 largestFreeBlock() const noexcept
+	{
+		for (UINT order = m_orderCount; order-- > 0;)
+		{
+			if (!m_freeBlocks[order].empty()) return blockSize(order);
+		}
+		return 0;
+	}
+
+private:
+	struct Allocation
+	{
+		UINT	order;
+		UINT64	size;
+	};
+
+	UINT64 blockSize(UINT order) const noexcept { return m_minBlockSize << order; }
+
+	UINT orderFor(UINT64 size) const noexcept
+	{
+		UINT order = 0;
+		while (blockSize(order) < size) order++;
+		return order;
+	}
+
+	UINT64											m_size = 0;
+	UINT64											m_minBlockSize = 0;
+	UINT											m_orderCount = 0;
+	std::vector<std::unordered_set<UINT64>>			m_freeBlocks;
+	std::unordered_map<UINT64, Allocation>			m_allocated;
+	UINT64											m_usedBytes = 0;
+	UINT64											m_requestedBytes = 0;
+};
+
+struct HeapStats
+{
+	UINT	heapCount = 0;
+	UINT64	reservedBytes = 0;		// Size of all ID3D12Heap blocks
+	UINT64	usedBytes = 0;			// Bytes in allocated buddy blocks
+	UINT64	requestedBytes = 0;		// Bytes actually asked for
+	UINT64	largestFreeBlock = 0;
+
+	// 0 when all free memory is one block, approaching 1 as it splinters.
+	float externalFragmentation() const noexcept
+	{
+		const UINT64 freeBytes = reservedBytes - usedBytes;
+		return freeBytes == 0 ? 0.0f : 1.0f - static_cast<float>(largestFreeBlock) / static_cast<float>(freeBytes);
+	}
+
+	// Share of allocated bytes lost to power-of-two rounding.
+	float internalFragmentation() const noexcept
+	{
+		return usedBytes == 0 ? 0.0f : 1.0f - static_cast<float>(requestedBytes) / static_cast<float>(usedBytes);
+	}
+};
+
+enum class HeapPoolType : UINT
+{
+	UploadBuffers,			// Shared mapped buffers, small buffers are packed at 256 bytes
+	DefaultBuffers,
+	DefaultTextures,
+	DefaultTargets,			// Render target textures
+	DefaultDepthStencils,
+	Count
+};
+
+struct HeapAllocation
+{
+	HeapPoolType	pool = HeapPoolType::Count;
+	UINT			block = 0;
+	UINT64			offset = 0;
+};
+
+// A placed resource with its own ID3D12Resource, for textures and default heap buffers.
+struct PlacedResource
+{
+	winrt::com_ptr<ID3D12Resource>	resource;
+	HeapAllocation					allocation;
+};
+
+// A range inside a shared upload buffer, for vertex/index/staging data.
+struct BufferRange
+{
+	ID3D12Resource*					resource = nullptr;
+	UINT64							offset = 0;
+	UINT8*							cpuAddress = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS		gpuAddress = 0;
+	HeapAllocation					allocation;
+};
+
+// Creates large ID3D12Heap blocks per heap type and places resources into them with a
+// buddy allocator, instead of paying a 64KB implicit heap and a kernel call per resource.
+class HeapManager
+{
+public:
+	// Heap blocks are reported to residency when given, placed resources cannot be tracked on their own.
+	void create(ID3D12Device* device, ResidencyManager* residency = nullptr)
+	{
+		m_device.copy_from(device);
+		m_residency = residency;
+
+		initPool(HeapPoolType::UploadBuffers, D3D12_HEAP_TYPE_UPLOAD, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, MemoryCategory::Upload, 256);
+		initPool(HeapPoolType::DefaultBuffers, D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, MemoryCategory::Buffer, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+		initPool(HeapPoolType::DefaultTextures, D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES, MemoryCategory::Texture, D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT);
+		initPool(HeapPoolType::DefaultTargets, D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES, MemoryCategory::RenderTarget, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+		initPool(HeapPoolType::DefaultDepthStencils, D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES, MemoryCategory::DepthStencil, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+	}
+
+	void destroy() noexcept
+	{
+		for (Pool& pool : m_pools)
+		{
+			if (m_residency)
+			{
+				for (Block& block : pool.blocks)
+				{
+					m_residency->untrack(block.heap.get());
+				}
+			}
+			pool.blocks.clear();
+		}
+		m_residency = nullptr;
+		m_pendingFrees.clear();
+		m_device = nullptr;
+	}
+
+	// Suballocate a range of a persistently mapped upload buffer.
+	BufferRange allocateUpload(UINT64 size, UINT64 alignment = 256)
+	{
+		BufferRange range;
+		range.allocation = allocate(HeapPoolType::UploadBuffers, size, alignment);
+
+		Block& block = m_pools[static_cast<UINT>(HeapPoolType::UploadBuffers)].blocks[range.allocation.block];
+		range.resource = block.buffer.get();
+		range.offset = range.allocation.offset;
+		range.cpuAddress = block.cpuAddress + range.offset;
+		range.gpuAddress = block.buffer->GetGPUVirtualAddress() + range.offset;
+		return range;
+	}
+
+	// Place a default heap buffer or texture.
+	PlacedResource createResource(D3D12_RESOURCE_DESC desc, D3D12_RESOURCE_STATES initialState, const D3D12_CLEAR_VALUE* clearValue = nullptr)
+	{
+		HeapPoolType poolType = HeapPoolType::DefaultBuffers;
+		if (desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)
+		{
+			poolType = HeapPoolType::DefaultDepthStencils;
+		}
+		else if (desc.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER)
+		{
+			const bool target = (desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET) != 0;
+			poolType = target ? HeapPoolType::DefaultTargets : HeapPoolType::DefaultTextures;
+		}
+
+		// Small textures can be packed at 4KB instead of 64KB when the driver agrees.
+		D3D12_RESOURCE_ALLOCATION_INFO allocationInfo{};
+		if (poolType == HeapPoolType::DefaultTextures)
+		{
+			desc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+			allocationInfo = m_device->GetResourceAllocationInfo(0, 1, &desc);
+			if (allocationInfo.Alignment != D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT)
+			{
+				desc.Alignment = 0;
+				allocationInfo = m_device->GetResourceAllocationInfo(0, 1, &desc);
+			}
+		}
+		else
+		{
+			allocationInfo = m_device->GetResourceAllocationInfo(0, 1, &desc);
+		}
+
+		PlacedResource placed;
+		placed.allocation = allocate(poolType, allocationInfo.SizeInBytes, allocationInfo.Alignment);
+
+		Block& block = m_pools[static_cast<UINT>(poolType)].blocks[placed.allocation.block];
+		winrt::check_hresult(m_device->CreatePlacedResource(
+			block.heap.get(),
+			placed.allocation.offset,
+			&desc,
+			initialState,
+			clearValue,
+			IID_ID3D12Resource,
+			placed.resource.put_void()
+		));
+		return placed;
+	}
+
+	// The range is reused once fenceValue has completed. Placed resources must be released by then.
+	void free(const HeapAllocation& allocation, UINT64 fenceValue)
+	{
+		if (allocation.pool == HeapPoolType::Count) return;
+		m_pendingFrees.push_back({ allocation, fenceValue });
+	}
+
+	void collect(UINT64 completedValue)
+	{
+		while (!m_pendingFrees.empty() && m_pendingFrees.front().fenceValue <= completedValue)
+		{
+			const HeapAllocation& allocation = m_pendingFrees.front().allocation;
+			m_pools[static_cast<UINT>(allocation.pool)].blocks[allocation.block].allocator.free(allocation.offset);
+			m_pendingFrees.pop_front();
+		}
+	}
+
+	ID3D12Heap* heap(const HeapAllocation& allocation) const noexcept
+	{
+		return m_pools[static_cast<UINT>(allocation.pool)].blocks[allocation.block].heap.get();
+	}
+
+	HeapStats stats(HeapPoolType poolType) const noexcept
+	{
+		HeapStats stats;
+		for (const Block& block : m_pools[static_cast<UINT>(poolType)].blocks)
+		{
+			stats.heapCount++;
+			stats.reservedBytes += block.allocator.size();
+			stats.usedBytes += block.allocator.usedBytes();
+			stats.requestedBytes += block.allocator.requestedBytes();
+			stats.largestFreeBlock = (std::max)(stats.largestFreeBlock, block.allocator.largestFreeBlock());
+		}
+		return stats;
+	}
+
+private:
+	struct Block
+	{
+		winrt::com_ptr<ID3D12Heap>		heap;
+		BuddyAllocator					allocator;
+
+		// Upload pool only: one buffer spanning the whole heap, mapped for its lifetime.
+		winrt::com_ptr<ID3D12Resource>	buffer;
+		UINT8*							cpuAddress = nullptr;
+	};
+
+	struct Pool
+	{
+		D3D12_HEAP_TYPE		heapType = D3D12_HEAP_TYPE_DEFAULT;
+		D3D12_HEAP_FLAGS	heapFlags = D3D12_HEAP_FLAG_NONE;
+		MemoryCategory		category = MemoryCategory::Buffer;
+		UINT64				minBlockSize = 0;
+		UINT64				nextBlockSize = HEAP_MIN_BLOCK_SIZE;
+		std::vector<Block>	blocks;
+	};
+
+	struct PendingFree
+	{
+		HeapAllocation	allocation;
+		UINT64			fenceValue;
+	};
+
+	void initPool(HeapPoolType poolType, D3D12_HEAP_TYPE heapType, D3D12_HEAP_FLAGS heapFlags, MemoryCategory category, UINT64 minBlockSize)
+	{
+		Pool& pool = m_pools[static_cast<UINT>(poolType)];
+		pool.heapType = heapType;
+		pool.heapFlags = heapFlags;
+		pool.category = category;
+		pool.minBlockSize = minBlockSize;
+		pool.nextBlockSize = HEAP_MIN_BLOCK_SIZE;
+		pool.blocks.clear();
+	}
+
+	HeapAllocation allocate(HeapPoolType poolType, UINT64 size, UINT64 alignment)
+	{
+		Pool& pool = m_pools[static_cast<UINT>(poolType)];
+
+		HeapAllocation allocation;
+		allocation.pool = poolType;
+		for (UINT i = 0; i < pool.blocks.size(); i++)
+		{
+			if (pool.blocks[i].allocator.allocate(size, alignment, allocation.offset))
+			{
+				allocation.block = i;
+				return allocation;
+			}
+		}
+
+		// Nothing fits, add a heap block at least twice the size of the last one.
+		allocation.block = static_cast<UINT>(pool.blocks.size());
+		Block& block = addBlock(pool, (std::max)({ pool.nextBlockSize, size, alignment }));
+		if (!block.allocator.allocate(size, alignment, allocation.offset))
+		{
+			throw std::runtime_error("Heap block too small for allocation");
+		}
+		pool.nextBlockSize = (std::max)(pool.nextBlockSize, (std::min)(block.allocator.size() * 2, HEAP_MAX_BLOCK_SIZE));
+		return allocation;
+	}
+
+	Block& addBlock(Pool& pool, UINT64 size)
+	{
+		pool.blocks.emplace_back();
+		Block& block = pool.blocks.back();
+		block.allocator.init(size, pool.minBlockSize);
+
+		CD3DX12_HEAP_DESC heapDesc(block.allocator.size(), pool.heapType, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, pool.heapFlags);
+		winrt::check_hresult(m_device->CreateHeap(&heapDesc, IID_ID3D12Heap, block.heap.put_void()));
+		if (m_residency)
+		{
+			m_residency->track(block.heap.get(), block.allocator.size(), pool.heapType, pool.category);
+		}
+
+		if (pool.heapType == D3D12_HEAP_TYPE_UPLOAD)
+		{
+			winrt::check_hresult(m_device->CreatePlacedResource(
+				block.heap.get(),
+				0,
+				&CD3DX12_RESOURCE_DESC::Buffer(block.allocator.size()),
+				D3D12_RESOURCE_STATE_GENERIC_READ,
+				nullptr,
+				IID_ID3D12Resource,
+				block.buffer.put_void()
+			));
+
+			CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
+			winrt::check_hresult(block.buffer->Map(0, &readRange, reinterpret_cast<void**>(&block.cpuAddress)));
+		}
+		return block;
+	}
+
+	winrt::com_ptr<ID3D12Device>	m_device;
+	ResidencyManager*				m_residency = nullptr;
+	Pool							m_pools[static_cast<UINT>(HeapPoolType::Count)];
+	std::deque<PendingFree>			m_pendingFrees;
+};
+
+#endif // HEAP_ALLOCATOR_H__
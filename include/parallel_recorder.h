@@ -0,0 +1,184 @@
+#ifndef PARALLEL_RECORDER_H__
+#define PARALLEL_RECORDER_H__
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+#include "command_allocator_pool.h"
+
+// Records one frame's work on several threads. Items [0, count) are split into one contiguous
+// range per thread, each thread records its range into its own command list, and the lists are
+// handed back in item order so a single ExecuteCommandLists keeps the submission order.
+//
+// Each range records into an allocator from the pool, released with the fence value that retires
+// the frame and the number of commands the range returns as recorded. Command lists do not inherit
+// state, each range must set its render targets, viewport, root signature and pipeline itself.
+class ParallelRecorder
+{
+public:
+	// Returns how many commands it recorded into commandList.
+	using RecordRange = std::function<UINT64(ID3D12GraphicsCommandList* commandList, UINT begin, UINT end)>;
+
+	~ParallelRecorder()
+	{
+		destroy();
+	}
+
+	// threadCount 0 uses one thread per hardware thread, the one calling record() included.
+	void create(ID3D12Device* device, CommandAllocatorPool* pool, UINT threadCount = 0, D3D12_COMMAND_LIST_TYPE type = D3D12_COMMAND_LIST_TYPE_DIRECT)
+	{
+		if (threadCount == 0)
+		{
+			threadCount = (std::max)(std::thread::hardware_concurrency(), 1U);
+		}
+
+		m_pool = pool;
+		m_type = type;
+		m_contexts.resize(threadCount);
+		for (ThreadContext& context : m_contexts)
+		{
+			// Nothing is recorded into the creation allocator, it can be reused right away.
+			ID3D12CommandAllocator* commandAllocator = m_pool->acquire(m_type, 0);
+			winrt::check_hresult(device->CreateCommandList(0, type, commandAllocator, nullptr, IID_ID3D12GraphicsCommandList, context.commandList.put_void()));
+			winrt::check_hresult(context.commandList->Close());
+			m_pool->release(commandAllocator, 0);
+		}
+
+		m_stopping = false;
+		m_generation = 0;
+		for (UINT i = 1; i < threadCount; i++)
+		{
+			m_workers.emplace_back([this, i]() { work(i); });
+		}
+	}
+
+	void destroy() noexcept
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_wake.notify_all();
+		for (std::thread& worker : m_workers)
+		{
+			worker.join();
+		}
+		m_workers.clear();
+		m_contexts.clear();
+		m_recordRange = nullptr;
+		m_pool = nullptr;
+	}
+
+	// Blocks until every range is recorded and closed, the calling thread records the first one.
+	// Allocators come back to the pool with fenceValue, which the frame's submission must signal.
+	// A failure on any thread is rethrown here.
+	void record(UINT64 completedValue, UINT64 fenceValue, UINT count, RecordRange recordRange)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_completedValue = completedValue;
+			m_fenceValue = fenceValue;
+			m_count = count;
+			m_recordRange = std::move(recordRange);
+			m_error = nullptr;
+			m_remaining = static_cast<UINT>(m_workers.size());
+			m_generation++;
+		}
+		m_wake.notify_all();
+
+		recordContext(0);
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this]() { return m_remaining == 0; });
+		if (m_error) std::rethrow_exception(m_error);
+	}
+
+	// Lists of the last record() in submission order, empty ranges included.
+	void append(std::vector<ID3D12CommandList*>& commandLists) const
+	{
+		for (const ThreadContext& context : m_contexts)
+		{
+			commandLists.push_back(context.commandList.get());
+		}
+	}
+
+	UINT threadCount() const noexcept { return static_cast<UINT>(m_contexts.size()); }
+
+private:
+	struct ThreadContext
+	{
+		winrt::com_ptr<ID3D12GraphicsCommandList>	commandList;
+	};
+
+	void work(UINT index)
+	{
+		UINT64 generation = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [this, generation]() { return m_stopping || m_generation != generation; });
+				if (m_stopping) return;
+				generation = m_generation;
+			}
+
+			recordContext(index);
+
+			bool last = false;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				last = --m_remaining == 0;
+			}
+			if (last) m_done.notify_one();
+		}
+	}
+
+	void recordContext(UINT index)
+	{
+		const UINT threads = static_cast<UINT>(m_contexts.size());
+		const UINT begin = static_cast<UINT>(static_cast<UINT64>(m_count) * index / threads);
+		const UINT end = static_cast<UINT>(static_cast<UINT64>(m_count) * (index + 1) / threads);
+
+		ThreadContext& context = m_contexts[index];
+		try
+		{
+			ID3D12CommandAllocator* commandAllocator = m_pool->acquire(m_type, m_completedValue);
+			winrt::check_hresult(context.commandList->Reset(commandAllocator, nullptr));
+			const UINT64 commands = begin < end ? m_recordRange(context.commandList.get(), begin, end) : 0;
+			winrt::check_hresult(context.commandList->Close());
+			m_pool->release(commandAllocator, m_fenceValue, commands);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_error) m_error = std::current_exception();
+		}
+	}
+
+	CommandAllocatorPool*					m_pool = nullptr;
+	D3D12_COMMAND_LIST_TYPE					m_type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+	std::vector<ThreadContext>				m_contexts;
+	std::vector<std::thread>				m_workers;
+	std::mutex								m_mutex;
+	std::condition_variable					m_wake;
+	std::condition_variable					m_done;
+	bool									m_stopping = false;
+	UINT64									m_generation = 0;
+	UINT									m_remaining = 0;
+	UINT64									m_completedValue = 0;
+	UINT64									m_fenceValue = 0;
+	UINT									m_count = 0;
+	RecordRange								m_recordRange;
+	std::exception_ptr						m_error;
+};
+
+#endif // PARALLEL_RECORDER_H__
@@ -0,0 +1,235 @@
+#ifndef PIPELINE_BUILDER_H__
+#define PIPELINE_BUILDER_H__
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+#include "pipeline_cache.h"
+
+using PipelineFuture = std::shared_future<winrt::com_ptr<ID3D12PipelineState>>;
+using ShaderFuture = std::shared_future<D3D12_SHADER_BYTECODE>;
+
+// A pipeline that may still be building. get() waits the first time it is called,
+// so a frame only blocks on the pipelines it actually binds.
+class PendingPipeline
+{
+public:
+	PendingPipeline& operator=(PipelineFuture future)
+	{
+		m_future = std::move(future);
+		m_pipeline = nullptr;
+		return *this;
+	}
+
+	PendingPipeline& operator=(std::nullptr_t) noexcept
+	{
+		m_future = {};
+		m_pipeline = nullptr;
+		return *this;
+	}
+
+	ID3D12PipelineState* get()
+	{
+		if (!m_pipeline && m_future.valid())
+		{
+			m_pipeline = m_future.get();
+			m_future = {};
+		}
+		return m_pipeline.get();
+	}
+
+	// Swap in a finished pipeline and hand back the previous one for deferred release.
+	// A build still in flight is superseded.
+	winrt::com_ptr<ID3D12PipelineState> replace(winrt::com_ptr<ID3D12PipelineState> pipeline)
+	{
+		m_future = {};
+		std::swap(m_pipeline, pipeline);
+		return pipeline;
+	}
+
+	bool ready() const
+	{
+		return m_pipeline || (m_future.valid() && m_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+	}
+
+private:
+	PipelineFuture							m_future;
+	winrt::com_ptr<ID3D12PipelineState>		m_pipeline;
+};
+
+// Creates pipeline states on a pool of worker threads. Each job waits for its own shaders,
+// so compiles from the shader cache and pipeline creation overlap across all pipelines.
+//
+// The description is copied together with its input layout and a reference to its root signature;
+// anything else it points to (stream output, cached blob) must outlive the returned future.
+class PipelineBuilder
+{
+public:
+	~PipelineBuilder()
+	{
+		destroy();
+	}
+
+	// With a cache, pipelines come from cached blobs where possible and the cache is saved
+	// whenever the queue runs dry. workerCount 0 uses one worker per hardware thread but the calling one.
+	void create(ID3D12Device* device, PipelineCache* cache = nullptr, UINT workerCount = 0)
+	{
+		m_device.copy_from(device);
+		m_cache = cache;
+		m_stopping = false;
+		m_running = 0;
+
+		if (workerCount == 0)
+		{
+			workerCount = (std::max)(std::thread::hardware_concurrency(), 2U) - 1;
+		}
+		for (UINT i = 0; i < workerCount; i++)
+		{
+			m_workers.emplace_back([this]() { work(); });
+		}
+	}
+
+	// Jobs not yet started are dropped, their futures report a broken promise.
+	void destroy() noexcept
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+			m_jobs.clear();
+		}
+		m_wake.notify_all();
+		for (std::thread& worker : m_workers)
+		{
+			worker.join();
+		}
+		m_workers.clear();
+		m_cache = nullptr;
+		m_device = nullptr;
+	}
+
+	PipelineFuture build(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, ShaderFuture vertexShader, ShaderFuture pixelShader)
+	{
+		auto job = std::make_shared<GraphicsJob>();
+		job->desc = desc;
+		job->rootSignature.copy_from(desc.pRootSignature);
+		job->vertexShader = std::move(vertexShader);
+		job->pixelShader = std::move(pixelShader);
+		job->semanticNames.reserve(desc.InputLayout.NumElements);
+		for (UINT i = 0; i < desc.InputLayout.NumElements; i++)
+		{
+			D3D12_INPUT_ELEMENT_DESC element = desc.InputLayout.pInputElementDescs[i];
+			job->semanticNames.emplace_back(element.SemanticName);
+			element.SemanticName = job->semanticNames.back().c_str();
+			job->inputElements.push_back(element);
+		}
+		job->desc.InputLayout = { job->inputElements.data(), desc.InputLayout.NumElements };
+
+		return submit([this, job]()
+		{
+			if (job->vertexShader.valid()) job->desc.VS = job->vertexShader.get();
+			if (job->pixelShader.valid()) job->desc.PS = job->pixelShader.get();
+			if (m_cache) return m_cache->createPipeline(job->desc);
+
+			winrt::com_ptr<ID3D12PipelineState> pipeline;
+			winrt::check_hresult(m_device->CreateGraphicsPipelineState(&job->desc, IID_ID3D12PipelineState, pipeline.put_void()));
+			return pipeline;
+		});
+	}
+
+	PipelineFuture build(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, ShaderFuture computeShader)
+	{
+		auto job = std::make_shared<ComputeJob>();
+		job->desc = desc;
+		job->rootSignature.copy_from(desc.pRootSignature);
+		job->computeShader = std::move(computeShader);
+
+		return submit([this, job]()
+		{
+			if (job->computeShader.valid()) job->desc.CS = job->computeShader.get();
+			if (m_cache) return m_cache->createPipeline(job->desc);
+
+			winrt::com_ptr<ID3D12PipelineState> pipeline;
+			winrt::check_hresult(m_device->CreateComputePipelineState(&job->desc, IID_ID3D12PipelineState, pipeline.put_void()));
+			return pipeline;
+		});
+	}
+
+private:
+	struct GraphicsJob
+	{
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC			desc{};
+		winrt::com_ptr<ID3D12RootSignature>			rootSignature;
+		std::vector<D3D12_INPUT_ELEMENT_DESC>		inputElements;
+		std::vector<std::string>					semanticNames;
+		ShaderFuture								vertexShader;
+		ShaderFuture								pixelShader;
+	};
+
+	struct ComputeJob
+	{
+		D3D12_COMPUTE_PIPELINE_STATE_DESC			desc{};
+		winrt::com_ptr<ID3D12RootSignature>			rootSignature;
+		ShaderFuture								computeShader;
+	};
+
+	PipelineFuture submit(std::function<winrt::com_ptr<ID3D12PipelineState>()> build)
+	{
+		auto task = std::make_shared<std::packaged_task<winrt::com_ptr<ID3D12PipelineState>()>>(std::move(build));
+		PipelineFuture future = task->get_future().share();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobs.push_back([task]() { (*task)(); });
+		}
+		m_wake.notify_one();
+		return future;
+	}
+
+	void work()
+	{
+		for (;;)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+				if (m_stopping) return;
+
+				job = std::move(m_jobs.front());
+				m_jobs.pop_front();
+				m_running++;
+			}
+			job();
+
+			bool idle = false;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				idle = --m_running == 0 && m_jobs.empty();
+			}
+			if (idle && m_cache) m_cache->save();
+		}
+	}
+
+	winrt::com_ptr<ID3D12Device>			m_device;
+	PipelineCache*							m_cache = nullptr;
+	std::vector<std::thread>				m_workers;
+	std::deque<std::function<void()>>		m_jobs;
+	std::mutex								m_mutex;
+	std::condition_variable					m_wake;
+	bool									m_stopping = false;
+	UINT									m_running = 0;
+};
+
+#endif // PIPELINE_BUILDER_H__
@@ -0,0 +1,477 @@
+#ifndef PIPELINE_CACHE_H__
+#define PIPELINE_CACHE_H__
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <winrt/base.h>
+
+#include <dxgi1_4.h>
+#include <d3d12.h>
+
+#include "d3dx12.h"
+#include "root_signature_cache.h"
+
+const char* const PIPELINE_CACHE_PATH = "cache/pipelines.bin";
+const UINT32 PIPELINE_CACHE_FORMAT_VERSION = 1;
+
+// The adapter and user-mode driver a cached blob was produced by. Blobs from any other are useless.
+struct AdapterIdentity
+{
+	UINT32	vendorId = 0;
+	UINT32	deviceId = 0;
+	UINT32	subSysId = 0;
+	UINT32	revision = 0;
+	UINT64	driverVersion = 0;
+
+	static AdapterIdentity query(ID3D12Device* device, IDXGIFactory4* factory)
+	{
+		winrt::com_ptr<IDXGIAdapter1> adapter;
+		winrt::check_hresult(factory->EnumAdapterByLuid(device->GetAdapterLuid(), IID_IDXGIAdapter1, adapter.put_void()));
+
+		DXGI_ADAPTER_DESC1 desc{};
+		winrt::check_hresult(adapter->GetDesc1(&desc));
+
+		LARGE_INTEGER umdVersion{};
+		adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &umdVersion);
+
+		AdapterIdentity identity;
+		identity.vendorId = desc.VendorId;
+		identity.deviceId = desc.DeviceId;
+		identity.subSysId = desc.SubSysId;
+		identity.revision = desc.Revision;
+		identity.driverVersion = static_cast<UINT64>(umdVersion.QuadPart);
+		return identity;
+	}
+
+	bool operator==(const AdapterIdentity& other) const noexcept
+	{
+		return vendorId == other.vendorId && deviceId == other.deviceId && subSysId == other.subSysId &&
+			revision == other.revision && driverVersion == other.driverVersion;
+	}
+};
+
+// The on-disk cache: a header naming the adapter and driver, then (key, size, blob) records.
+// Plain bytes in and out with no device involved, so it can be exercised offline with a made-up identity.
+//
+//     "LDPC" | format version | vendor | device | subsystem | revision | driver version (u64) | count
+//     count x ( key (u64) | size (u64) | size bytes )
+//
+// A file written for another adapter, driver or format version loads as empty.
+class PipelineCacheFile
+{
+public:
+	bool load(const std::string& path, const AdapterIdentity& identity)
+	{
+		m_entries.clear();
+		m_dirty = false;
+
+		std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+		if (!ifs) return false;
+
+		std::streamsize size = ifs.tellg();
+		if (size <= 0) return false;
+		ifs.seekg(0, std::ios::beg);
+
+		std::vector<char> bytes(static_cast<size_t>(size));
+		if (!ifs.read(bytes.data(), size)) return false;
+		return parse(bytes, identity);
+	}
+
+	bool parse(const std::vector<char>& bytes, const AdapterIdentity& identity)
+	{
+		m_entries.clear();
+
+		Reader reader{ bytes.data(), bytes.data() + bytes.size() };
+		char magic[4] = {};
+		AdapterIdentity fileIdentity;
+		UINT32 version = 0;
+		UINT32 count = 0;
+		if (!reader.read(magic, sizeof(magic)) || std::memcmp(magic, "LDPC", 4) != 0) return false;
+		if (!reader.value(version) || version != PIPELINE_CACHE_FORMAT_VERSION) return false;
+		if (!reader.value(fileIdentity.vendorId) || !reader.value(fileIdentity.deviceId) || !reader.value(fileIdentity.subSysId) ||
+			!reader.value(fileIdentity.revision) || !reader.value(fileIdentity.driverVersion) || !reader.value(count))
+		{
+			return false;
+		}
+
+		// A driver update invalidates every blob at once.
+		if (!(fileIdentity == identity)) return false;
+
+		for (UINT32 i = 0; i < count; i++)
+		{
+			UINT64 key = 0;
+			UINT64 blobSize = 0;
+			if (!reader.value(key) || !reader.value(blobSize) || blobSize > static_cast<UINT64>(reader.end - reader.cursor))
+			{
+				m_entries.clear();
+				return false;
+			}
+
+			Entry& entry = m_entries[key];
+			entry.blob.assign(reader.cursor, reader.cursor + blobSize);
+			reader.cursor += blobSize;
+		}
+		return true;
+	}
+
+	// Only entries used or added since load() are written, so blobs of changed shaders age out.
+	std::vector<char> serialize(const AdapterIdentity& identity) const
+	{
+		std::vector<char> bytes;
+		UINT32 count = 0;
+		for (const auto& [key, entry] : m_entries)
+		{
+			if (entry.used) count++;
+		}
+
+		append(bytes, "LDPC", 4);
+		appendValue(bytes, PIPELINE_CACHE_FORMAT_VERSION);
+		appendValue(bytes, identity.vendorId);
+		appendValue(bytes, identity.deviceId);
+		appendValue(bytes, identity.subSysId);
+		appendValue(bytes, identity.revision);
+		appendValue(bytes, identity.driverVersion);
+		appendValue(bytes, count);
+		for (const auto& [key, entry] : m_entries)
+		{
+			if (!entry.used) continue;
+
+			appendValue(bytes, key);
+			appendValue(bytes, static_cast<UINT64>(entry.blob.size()));
+			append(bytes, entry.blob.data(), entry.blob.size());
+		}
+		return bytes;
+	}
+
+	// Written under a temporary name and renamed so a crash never leaves a truncated cache.
+	bool save(const std::string& path, const AdapterIdentity& identity)
+	{
+		const std::vector<char> bytes = serialize(identity);
+
+		std::error_code error;
+		std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+		const std::string temporary = path + ".tmp";
+		{
+			std::ofstream ofs(temporary, std::ios::binary | std::ios::trunc);
+			ofs.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+			if (!ofs) return false;
+		}
+		std::filesystem::rename(temporary, path, error);
+		if (error) return false;
+
+		m_dirty = false;
+		return true;
+	}
+
+	// The returned blob stays valid until the next load().
+	const std::vector<char>* find(UINT64 key)
+	{
+		auto it = m_entries.find(key);
+		if (it == m_entries.end()) return nullptr;
+
+		if (!it->second.used) m_dirty = true;
+		it->second.used = true;
+		return &it->second.blob;
+	}
+
+	void insert(UINT64 key, const void* data, size_t size)
+	{
+		Entry& entry = m_entries[key];
+		entry.blob.assign(static_cast<const char*>(data), static_cast<const char*>(data) + size);
+		entry.used = true;
+		m_dirty = true;
+	}
+
+	size_t size() const noexcept { return m_entries.size(); }
+	bool dirty() const noexcept { return m_dirty; }
+
+private:
+	struct Entry
+	{
+		std::vector<char>	blob;
+		bool				used = false;
+	};
+
+	struct Reader
+	{
+		const char*	cursor;
+		const char*	end;
+
+		bool read(void* data, size_t size) noexcept
+		{
+			if (static_cast<size_t>(end - cursor) < size) return false;
+			std::memcpy(data, cursor, size);
+			cursor += size;
+			return true;
+		}
+
+		template <typename T>
+		bool value(T& value) noexcept { return read(&value, sizeof(value)); }
+	};
+
+	static void append(std::vector<char>& bytes, const void* data, size_t size)
+	{
+		bytes.insert(bytes.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+	}
+
+	template <typename T>
+	static void appendValue(std::vector<char>& bytes, const T& value)
+	{
+		append(bytes, &value, sizeof(value));
+	}
+
+	std::unordered_map<UINT64, Entry>	m_entries;
+	bool								m_dirty = false;
+};
+
+// Creates pipeline states from cached driver blobs (D3D12_CACHED_PIPELINE_STATE) keyed by a hash of the
+// full pipeline stream. Shaders are hashed by their bytecode and root signatures by the description hash
+// RootSignatureCache tags them with; pipelines using an untagged root signature are created uncached.
+//
+// Thread-safe, PipelineBuilder workers call it concurrently.
+class PipelineCache
+{
+public:
+	void create(ID3D12Device* device, IDXGIFactory4* factory, const char* path = PIPELINE_CACHE_PATH)
+	{
+		m_device.copy_from(device);
+		m_path = path;
+		m_identity = AdapterIdentity::query(device, factory);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_file.load(m_path, m_identity);
+	}
+
+	// Saves pending blobs.
+	void destroy() noexcept
+	{
+		try
+		{
+			save();
+		}
+		catch (...)
+		{
+		}
+		m_device = nullptr;
+	}
+
+	void save()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_file.dirty()) m_file.save(m_path, m_identity);
+	}
+
+	winrt::com_ptr<ID3D12PipelineState> createPipeline(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+	{
+		return createPipeline(desc, [this](const D3D12_GRAPHICS_PIPELINE_STATE_DESC& d, winrt::com_ptr<ID3D12PipelineState>& pipeline)
+		{
+			return m_device->CreateGraphicsPipelineState(&d, IID_ID3D12PipelineState, pipeline.put_void());
+		});
+	}
+
+	winrt::com_ptr<ID3D12PipelineState> createPipeline(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+	{
+		return createPipeline(desc, [this](const D3D12_COMPUTE_PIPELINE_STATE_DESC& d, winrt::com_ptr<ID3D12PipelineState>& pipeline)
+		{
+			return m_device->CreateComputePipelineState(&d, IID_ID3D12PipelineState, pipeline.put_void());
+		});
+	}
+
+	UINT hits() const noexcept { return m_hits; }
+	UINT misses() const noexcept { return m_misses; }
+	UINT rejected() const noexcept { return m_rejected; }
+
+	// FNV-1a over every subobject of the stream. Pointers are replaced by what they point to,
+	// structs with padding are hashed field by field. The cached blob itself is not part of the key.
+	static bool pipelineKey(const CD3DX12_PIPELINE_STATE_STREAM2& stream, UINT64& key)
+	{
+		Hasher hasher;
+
+		UINT64 rootSignatureHash = 0;
+		UINT size = sizeof(rootSignatureHash);
+		ID3D12RootSignature* rootSignature = stream.pRootSignature;
+		if (!rootSignature || FAILED(rootSignature->GetPrivateData(ROOT_SIGNATURE_HASH_GUID, &size, &rootSignatureHash))) return false;
+		hasher.value(rootSignatureHash);
+
+		hasher.value(static_cast<D3D12_PIPELINE_STATE_FLAGS>(stream.Flags));
+		hasher.value(static_cast<UINT>(stream.NodeMask));
+
+		const D3D12_INPUT_LAYOUT_DESC& inputLayout = stream.InputLayout;
+		hasher.value(inputLayout.NumElements);
+		for (UINT i = 0; i < inputLayout.NumElements; i++)
+		{
+			const D3D12_INPUT_ELEMENT_DESC& element = inputLayout.pInputElementDescs[i];
+			hasher.string(element.SemanticName);
+			hasher.value(element.SemanticIndex);
+			hasher.value(element.Format);
+			hasher.value(element.InputSlot);
+			hasher.value(element.AlignedByteOffset);
+			hasher.value(element.InputSlotClass);
+			hasher.value(element.InstanceDataStepRate);
+		}
+
+		hasher.value(static_cast<D3D12_INDEX_BUFFER_STRIP_CUT_VALUE>(stream.IBStripCutValue));
+		hasher.value(static_cast<D3D12_PRIMITIVE_TOPOLOGY_TYPE>(stream.PrimitiveTopologyType));
+
+		hasher.shader(stream.VS);
+		hasher.shader(stream.GS);
+		hasher.shader(stream.HS);
+		hasher.shader(stream.DS);
+		hasher.shader(stream.PS);
+		hasher.shader(stream.AS);
+		hasher.shader(stream.MS);
+		hasher.shader(stream.CS);
+
+		const D3D12_STREAM_OUTPUT_DESC& streamOutput = stream.StreamOutput;
+		hasher.value(streamOutput.NumEntries);
+		for (UINT i = 0; i < streamOutput.NumEntries; i++)
+		{
+			const D3D12_SO_DECLARATION_ENTRY& entry = streamOutput.pSODeclaration[i];
+			hasher.value(entry.Stream);
+			hasher.string(entry.SemanticName);
+			hasher.value(entry.SemanticIndex);
+			hasher.value(entry.StartComponent);
+			hasher.value(entry.ComponentCount);
+			hasher.value(entry.OutputSlot);
+		}
+		hasher.value(streamOutput.NumStrides);
+		hasher.bytes(streamOutput.pBufferStrides, sizeof(UINT) * streamOutput.NumStrides);
+		hasher.value(streamOutput.RasterizedStream);
+
+		const D3D12_BLEND_DESC& blend = stream.BlendState;
+		hasher.value(blend.AlphaToCoverageEnable);
+		hasher.value(blend.IndependentBlendEnable);
+		for (const D3D12_RENDER_TARGET_BLEND_DESC& target : blend.RenderTarget)
+		{
+			hasher.value(target.BlendEnable);
+			hasher.value(target.LogicOpEnable);
+			hasher.value(target.SrcBlend);
+			hasher.value(target.DestBlend);
+			hasher.value(target.BlendOp);
+			hasher.value(target.SrcBlendAlpha);
+			hasher.value(target.DestBlendAlpha);
+			hasher.value(target.BlendOpAlpha);
+			hasher.value(target.LogicOp);
+			hasher.value(target.RenderTargetWriteMask);
+		}
+
+		const D3D12_DEPTH_STENCIL_DESC1& depthStencil = stream.DepthStencilState;
+		hasher.value(depthStencil.DepthEnable);
+		hasher.value(depthStencil.DepthWriteMask);
+		hasher.value(depthStencil.DepthFunc);
+		hasher.value(depthStencil.StencilEnable);
+		hasher.value(depthStencil.StencilReadMask);
+		hasher.value(depthStencil.StencilWriteMask);
+		hasher.value(depthStencil.FrontFace);
+		hasher.value(depthStencil.BackFace);
+		hasher.value(depthStencil.DepthBoundsTestEnable);
+
+		hasher.value(static_cast<DXGI_FORMAT>(stream.DSVFormat));
+		hasher.value(static_cast<const D3D12_RASTERIZER_DESC&>(stream.RasterizerState));
+		hasher.value(static_cast<const D3D12_RT_FORMAT_ARRAY&>(stream.RTVFormats));
+		hasher.value(static_cast<const DXGI_SAMPLE_DESC&>(stream.SampleDesc));
+		hasher.value(static_cast<UINT>(stream.SampleMask));
+
+		const D3D12_VIEW_INSTANCING_DESC& viewInstancing = stream.ViewInstancingDesc;
+		hasher.value(viewInstancing.ViewInstanceCount);
+		hasher.bytes(viewInstancing.pViewInstanceLocations, sizeof(D3D12_VIEW_INSTANCE_LOCATION) * viewInstancing.ViewInstanceCount);
+		hasher.value(viewInstancing.Flags);
+
+		key = hasher.hash;
+		return true;
+	}
+
+private:
+	struct Hasher
+	{
+		UINT64	hash = 14695981039346656037ULL;
+
+		void bytes(const void* data, size_t size) noexcept
+		{
+			const unsigned char* p = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; i++)
+			{
+				hash = (hash ^ p[i]) * 1099511628211ULL;
+			}
+		}
+
+		template <typename T>
+		void value(const T& value) noexcept { bytes(&value, sizeof(value)); }
+
+		// A null name hashes like an empty one.
+		void string(const char* text) noexcept
+		{
+			if (!text) text = "";
+			bytes(text, std::strlen(text) + 1);
+		}
+
+		void shader(const D3D12_SHADER_BYTECODE& bytecode) noexcept
+		{
+			value(bytecode.BytecodeLength);
+			bytes(bytecode.pShaderBytecode, bytecode.BytecodeLength);
+		}
+	};
+
+	template <typename Desc, typename Create>
+	winrt::com_ptr<ID3D12PipelineState> createPipeline(Desc desc, Create create)
+	{
+		UINT64 key = 0;
+		const bool cacheable = pipelineKey(CD3DX12_PIPELINE_STATE_STREAM2(desc), key);
+
+		winrt::com_ptr<ID3D12PipelineState> pipeline;
+		if (cacheable)
+		{
+			std::vector<char> blob;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (const std::vector<char>* cached = m_file.find(key)) blob = *cached;
+			}
+
+			if (!blob.empty())
+			{
+				desc.CachedPSO = { blob.data(), blob.size() };
+				if (SUCCEEDED(create(desc, pipeline)))
+				{
+					m_hits++;
+					return pipeline;
+				}
+
+				// D3D12_ERROR_DRIVER_VERSION_MISMATCH or a blob that does not match the description.
+				m_rejected++;
+				pipeline = nullptr;
+				desc.CachedPSO = {};
+			}
+		}
+
+		winrt::check_hresult(create(desc, pipeline));
+		if (!cacheable) return pipeline;
+
+		m_misses++;
+		winrt::com_ptr<ID3DBlob> blob;
+		if (SUCCEEDED(pipeline->GetCachedBlob(blob.put())))
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_file.insert(key, blob->GetBufferPointer(), blob->GetBufferSize());
+		}
+		return pipeline;
+	}
+
+	winrt::com_ptr<ID3D12Device>	m_device;
+	std::string						m_path;
+	AdapterIdentity					m_identity;
+	PipelineCacheFile				m_file;
+	std::mutex						m_mutex;
+	std::atomic<UINT>				m_hits{ 0 };
+	std::atomic<UINT>				m_misses{ 0 };
+	std::atomic<UINT>				m_rejected{ 0 };
+};
+
+#endif // PIPELINE_CACHE_H__
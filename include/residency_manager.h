@@ -0,0 +1,265 @@
+#ifndef RESIDENCY_MANAGER_H__
+#define RESIDENCY_MANAGER_H__
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include <winrt/base.h>
+
+#include <dxgi1_4.h>
+#include <d3d12.h>
+
+enum class MemoryCategory : UINT
+{
+	RenderTarget,
+	DepthStencil,
+	Texture,
+	Buffer,
+	Upload,
+	Count
+};
+
+// Where the budget comes from and how residency is changed. The D3D12 backend below talks to the
+// adapter and device; a stand-in can report any budget and record evictions instead.
+class MemoryBackend
+{
+public:
+	virtual ~MemoryBackend() = default;
+
+	// Bytes this process may use in the segment group right now.
+	virtual UINT64 budget(DXGI_MEMORY_SEGMENT_GROUP segmentGroup) = 0;
+
+	virtual void makeResident(ID3D12Pageable* object) = 0;
+	virtual void evict(ID3D12Pageable* object) = 0;
+};
+
+// Budget from IDXGIAdapter3::QueryVideoMemoryInfo, optionally capped so several instances
+// can share one GPU without oversubscribing it.
+class D3D12MemoryBackend : public MemoryBackend
+{
+public:
+	void create(ID3D12Device* device, IDXGIFactory4* factory, UINT64 budgetCap = 0)
+	{
+		m_device.copy_from(device);
+		m_budgetCap = budgetCap;
+		winrt::check_hresult(factory->EnumAdapterByLuid(device->GetAdapterLuid(), IID_IDXGIAdapter3, m_adapter.put_void()));
+	}
+
+	void destroy() noexcept
+	{
+		m_adapter = nullptr;
+		m_device = nullptr;
+	}
+
+	UINT64 budget(DXGI_MEMORY_SEGMENT_GROUP segmentGroup) override
+	{
+		DXGI_QUERY_VIDEO_MEMORY_INFO info{};
+		winrt::check_hresult(m_adapter->QueryVideoMemoryInfo(0, segmentGroup, &info));
+		return m_budgetCap == 0 ? info.Budget : (std::min)(info.Budget, m_budgetCap);
+	}
+
+	void makeResident(ID3D12Pageable* object) override
+	{
+		winrt::check_hresult(m_device->MakeResident(1, &object));
+	}
+
+	void evict(ID3D12Pageable* object) override
+	{
+		winrt::check_hresult(m_device->Evict(1, &object));
+	}
+
+private:
+	winrt::com_ptr<ID3D12Device>	m_device;
+	winrt::com_ptr<IDXGIAdapter3>	m_adapter;
+	UINT64							m_budgetCap = 0;
+};
+
+// Stand-in backend with budgets set by hand that records residency changes instead of making them,
+// so eviction decisions can be checked without a GPU. Segment groups without a budget never trim.
+struct FakeMemoryBackend : MemoryBackend
+{
+	UINT64							budgets[2] = { (std::numeric_limits<UINT64>::max)(), (std::numeric_limits<UINT64>::max)() };
+	std::vector<ID3D12Pageable*>	madeResident;
+	std::vector<ID3D12Pageable*>	evicted;
+
+	void setBudget(DXGI_MEMORY_SEGMENT_GROUP segmentGroup, UINT64 bytes) { budgets[segmentGroup] = bytes; }
+
+	UINT64 budget(DXGI_MEMORY_SEGMENT_GROUP segmentGroup) override { return budgets[segmentGroup]; }
+	void makeResident(ID3D12Pageable* object) override { madeResident.push_back(object); }
+	void evict(ID3D12Pageable* object) override { evicted.push_back(object); }
+};
+
+struct MemoryStats
+{
+	// Live bytes by heap type (DEFAULT, UPLOAD, READBACK, CUSTOM) and category.
+	UINT64	bytes[4][static_cast<UINT>(MemoryCategory::Count)] = {};
+
+	UINT64	totalBytes = 0;
+	UINT64	residentBytes = 0;
+	UINT64	frameHighWaterBytes = 0;	// Peak since the last beginFrame()
+	UINT64	highWaterBytes = 0;			// Peak since create()
+	UINT64	evictedBytes = 0;
+	UINT	evictions = 0;
+};
+
+// Accounts every tracked heap or committed resource by heap type and category and keeps the
+// resident set of each segment group under budget by evicting least recently used objects.
+//
+// Objects are keyed by their ID3D12Pageable pointer. Placed resources cannot be made resident
+// on their own, track their ID3D12Heap instead.
+class ResidencyManager
+{
+public:
+	void create(MemoryBackend* backend)
+	{
+		m_backend = backend;
+		m_objects.clear();
+		m_stats = {};
+		m_frame = 0;
+	}
+
+	void destroy() noexcept
+	{
+		m_objects.clear();
+		m_backend = nullptr;
+	}
+
+	void track(ID3D12Pageable* object, UINT64 size, D3D12_HEAP_TYPE heapType, MemoryCategory category)
+	{
+		if (!object || m_objects.count(object)) return;
+
+		Object& tracked = m_objects[object];
+		tracked.size = size;
+		tracked.heapType = heapType;
+		tracked.category = category;
+		tracked.lastUsedFrame = m_frame;
+
+		bytes(tracked) += size;
+		m_stats.totalBytes += size;
+		m_stats.residentBytes += size;
+		m_stats.frameHighWaterBytes = (std::max)(m_stats.frameHighWaterBytes, m_stats.totalBytes);
+		m_stats.highWaterBytes = (std::max)(m_stats.highWaterBytes, m_stats.totalBytes);
+	}
+
+	// Call before the object itself is released.
+	void untrack(ID3D12Pageable* object) noexcept
+	{
+		auto it = m_objects.find(object);
+		if (it == m_objects.end()) return;
+
+		bytes(it->second) -= it->second.size;
+		m_stats.totalBytes -= it->second.size;
+		if (it->second.resident) m_stats.residentBytes -= it->second.size;
+		m_objects.erase(it);
+	}
+
+	// Mark the object as used by work recorded this frame, paging it back in if it was evicted.
+	void use(ID3D12Pageable* object, UINT64 fenceValue)
+	{
+		auto it = m_objects.find(object);
+		if (it == m_objects.end()) return;
+
+		Object& tracked = it->second;
+		tracked.lastUsedFrame = m_frame;
+		tracked.lastUsedFence = (std::max)(tracked.lastUsedFence, fenceValue);
+		if (!tracked.resident)
+		{
+			m_backend->makeResident(object);
+			tracked.resident = true;
+			m_stats.residentBytes += tracked.size;
+		}
+	}
+
+	// Start a new frame and bring each segment group back under budget. Only objects whose last
+	// use has completed on the GPU (fence value <= completedValue) are eviction candidates.
+	void beginFrame(UINT64 completedValue)
+	{
+		m_frame++;
+		m_stats.frameHighWaterBytes = m_stats.totalBytes;
+
+		trim(DXGI_MEMORY_SEGMENT_GROUP_LOCAL, completedValue);
+		trim(DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL, completedValue);
+	}
+
+	const MemoryStats& stats() const noexcept { return m_stats; }
+
+	UINT64 bytes(D3D12_HEAP_TYPE heapType, MemoryCategory category) const noexcept
+	{
+		return m_stats.bytes[heapTypeIndex(heapType)][static_cast<UINT>(category)];
+	}
+
+private:
+	struct Object
+	{
+		UINT64				size = 0;
+		D3D12_HEAP_TYPE		heapType = D3D12_HEAP_TYPE_DEFAULT;
+		MemoryCategory		category = MemoryCategory::Buffer;
+		UINT64				lastUsedFrame = 0;
+		UINT64				lastUsedFence = 0;
+		bool				resident = true;
+	};
+
+	static UINT heapTypeIndex(D3D12_HEAP_TYPE heapType) noexcept
+	{
+		return (std::min)(static_cast<UINT>(heapType), 4U) - 1;
+	}
+
+	// DEFAULT heaps live in video memory, UPLOAD and READBACK in system memory on discrete GPUs.
+	static DXGI_MEMORY_SEGMENT_GROUP segmentGroup(D3D12_HEAP_TYPE heapType) noexcept
+	{
+		return heapType == D3D12_HEAP_TYPE_DEFAULT ? DXGI_MEMORY_SEGMENT_GROUP_LOCAL : DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL;
+	}
+
+	UINT64& bytes(const Object& object) noexcept
+	{
+		return m_stats.bytes[heapTypeIndex(object.heapType)][static_cast<UINT>(object.category)];
+	}
+
+	void trim(DXGI_MEMORY_SEGMENT_GROUP group, UINT64 completedValue)
+	{
+		UINT64 resident = 0;
+		for (const auto& [object, tracked] : m_objects)
+		{
+			if (tracked.resident && segmentGroup(tracked.heapType) == group) resident += tracked.size;
+		}
+
+		const UINT64 budget = m_backend->budget(group);
+		if (resident <= budget) return;
+
+		// Oldest first, never anything used this frame or still in flight.
+		m_candidates.clear();
+		for (auto& [object, tracked] : m_objects)
+		{
+			if (!tracked.resident || segmentGroup(tracked.heapType) != group) continue;
+			if (tracked.lastUsedFrame == m_frame || tracked.lastUsedFence > completedValue) continue;
+			m_candidates.push_back(object);
+		}
+		std::sort(m_candidates.begin(), m_candidates.end(), [this](ID3D12Pageable* a, ID3D12Pageable* b)
+		{
+			return m_objects[a].lastUsedFrame < m_objects[b].lastUsedFrame;
+		});
+
+		for (ID3D12Pageable* object : m_candidates)
+		{
+			if (resident <= budget) break;
+
+			Object& tracked = m_objects[object];
+			m_backend->evict(object);
+			tracked.resident = false;
+			resident -= tracked.size;
+			m_stats.residentBytes -= tracked.size;
+			m_stats.evictedBytes += tracked.size;
+			m_stats.evictions++;
+		}
+	}
+
+	MemoryBackend*									m_backend = nullptr;
+	std::unordered_map<ID3D12Pageable*, Object>		m_objects;
+	std::vector<ID3D12Pageable*>					m_candidates;
+	MemoryStats										m_stats;
+	UINT64											m_frame = 0;
+};
+
+#endif // RESIDENCY_MANAGER_H__
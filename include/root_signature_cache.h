@@ -0,0 +1,226 @@
+#ifndef ROOT_SIGNATURE_CACHE_H__
+#define ROOT_SIGNATURE_CACHE_H__
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+#include "d3dx12.h"
+
+const char* const ROOT_SIGNATURE_CACHE_DIRECTORY = "cache/root_signatures";
+
+// Private data on every cached root signature holding its UINT64 description hash, a stable
+// identity other caches can key on where the pointer would change between runs.
+const GUID ROOT_SIGNATURE_HASH_GUID = { 0x3c5d2a41, 0x9e7b, 0x4f18, { 0xa6, 0x0d, 0x52, 0xe1, 0x7c, 0x94, 0x2b, 0x6f } };
+
+// Root signatures keyed by a hash of their description. Identical descriptions share one
+// ID3D12RootSignature, and serialized blobs are kept in memory and in ROOT_SIGNATURE_CACHE_DIRECTORY
+// so later runs and device-lost recovery create signatures without serializing them again.
+//
+// destroy() releases the root signatures but keeps the blobs, create() the cache again on the new device.
+class RootSignatureCache
+{
+public:
+	void create(ID3D12Device* device, const char* directory = ROOT_SIGNATURE_CACHE_DIRECTORY)
+	{
+		m_device.copy_from(device);
+		m_directory = directory;
+
+		// Serialize 1.1 descriptions as 1.0 on runtimes that lack 1.1.
+		D3D12_FEATURE_DATA_ROOT_SIGNATURE feature{};
+		feature.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
+		m_highestVersion = SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &feature, sizeof(feature)))
+			? feature.HighestVersion : D3D_ROOT_SIGNATURE_VERSION_1_0;
+	}
+
+	void destroy() noexcept
+	{
+		for (auto& [hash, entry] : m_entries)
+		{
+			entry.rootSignature = nullptr;
+		}
+		m_device = nullptr;
+	}
+
+	// The returned signature is owned by the cache, copy_from() it to keep a reference.
+	ID3D12RootSignature* get(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc)
+	{
+		const D3D_ROOT_SIGNATURE_VERSION version = desc.Version < m_highestVersion ? desc.Version : m_highestVersion;
+		const UINT64 hash = hashDesc(desc, version);
+
+		Entry& entry = m_entries[hash];
+		if (entry.rootSignature) return entry.rootSignature.get();
+
+		if (!entry.blob.empty() && createFromBlob(entry))
+		{
+			tag(entry.rootSignature.get(), hash);
+			return entry.rootSignature.get();
+		}
+
+		const std::string path = pathOf(hash);
+		if (load(path, entry.blob) && createFromBlob(entry))
+		{
+			m_diskLoads++;
+			tag(entry.rootSignature.get(), hash);
+			return entry.rootSignature.get();
+		}
+
+		winrt::com_ptr<ID3DBlob> signature;
+		winrt::com_ptr<ID3DBlob> error;
+		if (FAILED(D3DX12SerializeVersionedRootSignature(&desc, version, signature.put(), error.put())))
+		{
+			m_entries.erase(hash);
+			throw std::runtime_error(error ? static_cast<const char*>(error->GetBufferPointer()) : "Root signature serialization failed");
+		}
+		m_serializations++;
+
+		const char* bytes = static_cast<const char*>(signature->GetBufferPointer());
+		entry.blob.assign(bytes, bytes + signature->GetBufferSize());
+		winrt::check_hresult(m_device->CreateRootSignature(0, entry.blob.data(), entry.blob.size(), IID_ID3D12RootSignature, entry.rootSignature.put_void()));
+		store(path, entry.blob);
+		tag(entry.rootSignature.get(), hash);
+		return entry.rootSignature.get();
+	}
+
+	ID3D12RootSignature* get(const D3D12_ROOT_SIGNATURE_DESC& desc)
+	{
+		CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC versionedDesc;
+		versionedDesc.Init_1_0(desc.NumParameters, desc.pParameters, desc.NumStaticSamplers, desc.pStaticSamplers, desc.Flags);
+		return get(versionedDesc);
+	}
+
+	size_t size() const noexcept { return m_entries.size(); }
+	UINT serializations() const noexcept { return m_serializations; }
+	UINT diskLoads() const noexcept { return m_diskLoads; }
+
+private:
+	struct Entry
+	{
+		std::vector<char>						blob;
+		winrt::com_ptr<ID3D12RootSignature>		rootSignature;
+	};
+
+	// FNV-1a. Ranges, root constants, root descriptors and static samplers are all 32-bit fields
+	// without padding, so they are hashed as raw bytes; only root parameters hold pointers.
+	static void hashBytes(UINT64& hash, const void* data, size_t size) noexcept
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * 1099511628211ULL;
+		}
+	}
+
+	template <typename T>
+	static void hashValue(UINT64& hash, const T& value) noexcept
+	{
+		hashBytes(hash, &value, sizeof(value));
+	}
+
+	template <typename Parameter>
+	static void hashParameter(UINT64& hash, const Parameter& parameter) noexcept
+	{
+		hashValue(hash, parameter.ParameterType);
+		hashValue(hash, parameter.ShaderVisibility);
+		switch (parameter.ParameterType)
+		{
+		case D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE:
+			hashValue(hash, parameter.DescriptorTable.NumDescriptorRanges);
+			hashBytes(hash, parameter.DescriptorTable.pDescriptorRanges, sizeof(*parameter.DescriptorTable.pDescriptorRanges) * parameter.DescriptorTable.NumDescriptorRanges);
+			break;
+		case D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS:
+			hashValue(hash, parameter.Constants);
+			break;
+		default:
+			hashValue(hash, parameter.Descriptor);
+			break;
+		}
+	}
+
+	template <typename Desc>
+	static void hashRootSignature(UINT64& hash, const Desc& desc) noexcept
+	{
+		hashValue(hash, desc.Flags);
+		hashValue(hash, desc.NumParameters);
+		for (UINT i = 0; i < desc.NumParameters; i++)
+		{
+			hashParameter(hash, desc.pParameters[i]);
+		}
+		hashValue(hash, desc.NumStaticSamplers);
+		hashBytes(hash, desc.pStaticSamplers, sizeof(*desc.pStaticSamplers) * desc.NumStaticSamplers);
+	}
+
+	static UINT64 hashDesc(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc, D3D_ROOT_SIGNATURE_VERSION serializedVersion) noexcept
+	{
+		UINT64 hash = 14695981039346656037ULL;
+		hashValue(hash, desc.Version);
+		hashValue(hash, serializedVersion);
+		if (desc.Version == D3D_ROOT_SIGNATURE_VERSION_1_0)
+		{
+			hashRootSignature(hash, desc.Desc_1_0);
+		}
+		else
+		{
+			hashRootSignature(hash, desc.Desc_1_1);
+		}
+		return hash;
+	}
+
+	std::string pathOf(UINT64 hash) const
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016llx.rootsig", static_cast<unsigned long long>(hash));
+		return m_directory + "/" + name;
+	}
+
+	static void tag(ID3D12RootSignature* rootSignature, UINT64 hash)
+	{
+		winrt::check_hresult(rootSignature->SetPrivateData(ROOT_SIGNATURE_HASH_GUID, sizeof(hash), &hash));
+	}
+
+	// A stale or corrupt blob fails here and is serialized again.
+	bool createFromBlob(Entry& entry)
+	{
+		return SUCCEEDED(m_device->CreateRootSignature(0, entry.blob.data(), entry.blob.size(), IID_ID3D12RootSignature, entry.rootSignature.put_void()));
+	}
+
+	static bool load(const std::string& path, std::vector<char>& blob)
+	{
+		std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+		if (!ifs) return false;
+
+		std::streamsize size = ifs.tellg();
+		if (size <= 0) return false;
+		ifs.seekg(0, std::ios::beg);
+
+		blob.resize(static_cast<size_t>(size));
+		return static_cast<bool>(ifs.read(blob.data(), size));
+	}
+
+	// Best effort, a read-only working directory only costs the disk cache.
+	void store(const std::string& path, const std::vector<char>& blob) const
+	{
+		std::error_code error;
+		std::filesystem::create_directories(m_directory, error);
+
+		std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+		ofs.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+	}
+
+	winrt::com_ptr<ID3D12Device>				m_device;
+	std::string									m_directory;
+	D3D_ROOT_SIGNATURE_VERSION					m_highestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
+	std::unordered_map<UINT64, Entry>			m_entries;
+	UINT										m_serializations = 0;
+	UINT										m_diskLoads = 0;
+};
+
+#endif // ROOT_SIGNATURE_CACHE_H__
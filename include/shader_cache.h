@@ -0,0 +1,321 @@
+#ifndef SHADER_CACHE_H__
+#define SHADER_CACHE_H__
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Windows.h>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+#include <d3dcompiler.h>
+
+const char* const SHADER_CACHE_DIRECTORY = "cache/shaders";
+
+// Development builds point this at the source tree so edits are picked up in place.
+#ifndef LEARN_DX_SHADER_DIR
+#define LEARN_DX_SHADER_DIR "shaders"
+#endif
+
+// Bytecode compiled by the build, see learn_dx_shader() in CMakeLists.txt. The name is
+// <file>:<entry point>:<target> followed by :<define>=<value> for each define in order.
+struct EmbeddedShader
+{
+	const char*		name;
+	const BYTE*		bytecode;
+	SIZE_T			size;
+};
+
+// The table learn_dx_shader() generates, empty when the build could not run fxc.
+struct EmbeddedShaders
+{
+	const EmbeddedShader*	shaders;
+	size_t					count;
+};
+
+// Compiled shader bytecode addressed by a hash of everything that affects it: source, defines,
+// entry point, target profile, compile flags and compiler version.
+//
+// Hits map <hash>.cso from SHADER_CACHE_DIRECTORY read-only, so a warm start runs no compiler at all.
+// Misses compile on a background thread and write the file for the next run; request() every shader
+// first and get() the futures afterwards so misses compile concurrently.
+//
+// Bytecode stays valid until destroy(). Nothing here depends on the device, the cache survives device loss.
+// request() may be called from any thread.
+//
+// Only development builds (LEARN_DX_RUNTIME_SHADERS) can compile. Release builds use the shaders
+// embedded by the build and never load the compiler, a miss there fails the future.
+class ShaderCache
+{
+public:
+	void create(const char* directory = SHADER_CACHE_DIRECTORY)
+	{
+		m_directory = directory;
+	}
+
+	// Makes bytecode compiled by the build available to requestFile().
+	void embed(const EmbeddedShaders& shaders)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (size_t i = 0; i < shaders.count; i++)
+		{
+			const EmbeddedShader& shader = shaders.shaders[i];
+			m_embedded[shader.name] = { shader.bytecode, shader.size };
+		}
+	}
+
+	// Waits for background compiles, then unmaps and releases all bytecode.
+	void destroy() noexcept
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& [hash, entry] : m_entries)
+		{
+			if (entry->bytecode.valid()) entry->bytecode.wait();
+		}
+		m_entries.clear();
+		m_embedded.clear();
+	}
+
+	// get() on the future rethrows compile errors with the compiler's message.
+	std::shared_future<D3D12_SHADER_BYTECODE> request(const char* source, const char* entryPoint, const char* target, UINT flags, const D3D_SHADER_MACRO* defines = nullptr)
+	{
+		const UINT64 hash = hashKey(source, entryPoint, target, flags, defines);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::unique_ptr<Entry>& entry = m_entries[hash];
+		if (entry)
+		{
+			m_memoryHits++;
+			return entry->bytecode;
+		}
+		entry = std::make_unique<Entry>();
+
+		const std::string path = pathOf(hash);
+		if (entry->map(path))
+		{
+			m_diskHits++;
+			std::promise<D3D12_SHADER_BYTECODE> ready;
+			ready.set_value({ entry->view, entry->size });
+			entry->bytecode = ready.get_future().share();
+			return entry->bytecode;
+		}
+
+#if defined(LEARN_DX_RUNTIME_SHADERS)
+		// The task owns copies of its inputs, callers' strings only need to outlive this call.
+		m_compiles++;
+		Entry* output = entry.get();
+		entry->bytecode = std::async(std::launch::async,
+			[output, path, directory = m_directory, source = std::string(source), entryPoint = std::string(entryPoint), target = std::string(target), flags, defines = copyDefines(defines)]()
+		{
+			std::vector<D3D_SHADER_MACRO> macros;
+			for (const auto& [name, value] : defines)
+			{
+				macros.push_back({ name.c_str(), value.c_str() });
+			}
+			macros.push_back({ nullptr, nullptr });
+
+			winrt::com_ptr<ID3DBlob> error;
+			if (FAILED(D3DCompile(source.data(), source.size(), nullptr, macros.data(), nullptr, entryPoint.c_str(), target.c_str(), flags, 0, output->blob.put(), error.put())))
+			{
+				throw std::runtime_error(error ? static_cast<const char*>(error->GetBufferPointer()) : "Shader compilation failed");
+			}
+
+			store(directory, path, output->blob.get());
+			return D3D12_SHADER_BYTECODE{ output->blob->GetBufferPointer(), output->blob->GetBufferSize() };
+		}).share();
+#else
+		std::promise<D3D12_SHADER_BYTECODE> missing;
+		missing.set_exception(std::make_exception_ptr(std::runtime_error(std::string("Shader ") + entryPoint + " (" + target + ") is not embedded, runtime compilation is disabled in release builds")));
+		entry->bytecode = missing.get_future().share();
+#endif
+		return entry->bytecode;
+	}
+
+	// Shader file under LEARN_DX_SHADER_DIR. Embedded bytecode is used when the build compiled this
+	// permutation, otherwise the file is read and goes through request().
+	std::shared_future<D3D12_SHADER_BYTECODE> requestFile(const char* file, const char* entryPoint, const char* target, UINT flags, const D3D_SHADER_MACRO* defines = nullptr)
+	{
+		std::string name = std::string(file) + ":" + entryPoint + ":" + target;
+		for (const D3D_SHADER_MACRO* define = defines; define && define->Name; define++)
+		{
+			name += std::string(":") + define->Name + "=" + (define->Definition ? define->Definition : "");
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_embedded.find(name);
+			if (it != m_embedded.end())
+			{
+				m_embeddedHits++;
+				std::promise<D3D12_SHADER_BYTECODE> ready;
+				ready.set_value(it->second);
+				return ready.get_future().share();
+			}
+		}
+
+#if defined(LEARN_DX_RUNTIME_SHADERS)
+		std::ifstream ifs(std::string(LEARN_DX_SHADER_DIR) + "/" + file, std::ios::binary);
+		if (!ifs)
+		{
+			throw std::runtime_error("Cannot read shader " + name);
+		}
+		const std::string source((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+		return request(source.c_str(), entryPoint, target, flags, defines);
+#else
+		throw std::runtime_error("Shader " + name + " is not embedded, add it to learn_dx_shader() in CMakeLists.txt");
+#endif
+	}
+
+	D3D12_SHADER_BYTECODE get(const char* source, const char* entryPoint, const char* target, UINT flags, const D3D_SHADER_MACRO* defines = nullptr)
+	{
+		return request(source, entryPoint, target, flags, defines).get();
+	}
+
+	UINT memoryHits() const noexcept { return m_memoryHits; }
+	UINT diskHits() const noexcept { return m_diskHits; }
+	UINT compiles() const noexcept { return m_compiles; }
+	UINT embeddedHits() const noexcept { return m_embeddedHits; }
+
+private:
+	// Bytecode is either a read-only view of the cache file or the compiler's blob.
+	struct Entry
+	{
+		std::shared_future<D3D12_SHADER_BYTECODE>	bytecode;
+		winrt::com_ptr<ID3DBlob>					blob;
+		HANDLE										file = INVALID_HANDLE_VALUE;
+		HANDLE										mapping = nullptr;
+		const void*									view = nullptr;
+		SIZE_T										size = 0;
+
+		~Entry()
+		{
+			unmap();
+		}
+
+		bool map(const std::string& path)
+		{
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) return false;
+
+			LARGE_INTEGER fileSize{};
+			if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart >= 32)
+			{
+				mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			}
+			if (mapping)
+			{
+				view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			}
+
+			// A truncated or foreign file is treated as a miss and compiled again.
+			UINT32 containerSize = 0;
+			if (view) std::memcpy(&containerSize, static_cast<const char*>(view) + 24, sizeof(containerSize));
+			if (!view || std::memcmp(view, "DXBC", 4) != 0 || containerSize != fileSize.QuadPart)
+			{
+				unmap();
+				return false;
+			}
+
+			size = static_cast<SIZE_T>(fileSize.QuadPart);
+			return true;
+		}
+
+		void unmap() noexcept
+		{
+			if (view) UnmapViewOfFile(view);
+			if (mapping) CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+			view = nullptr;
+			mapping = nullptr;
+			file = INVALID_HANDLE_VALUE;
+		}
+	};
+
+	using Defines = std::vector<std::pair<std::string, std::string>>;
+
+	static Defines copyDefines(const D3D_SHADER_MACRO* defines)
+	{
+		Defines copy;
+		for (; defines && defines->Name; defines++)
+		{
+			copy.emplace_back(defines->Name, defines->Definition ? defines->Definition : "");
+		}
+		return copy;
+	}
+
+	// FNV-1a, each string including its terminator so adjacent fields cannot run together.
+	static void hashString(UINT64& hash, const char* text) noexcept
+	{
+		do
+		{
+			hash = (hash ^ static_cast<unsigned char>(*text)) * 1099511628211ULL;
+		} while (*text++);
+	}
+
+	static UINT64 hashKey(const char* source, const char* entryPoint, const char* target, UINT flags, const D3D_SHADER_MACRO* defines) noexcept
+	{
+		UINT64 hash = 14695981039346656037ULL;
+		hashString(hash, source);
+		hashString(hash, entryPoint);
+		hashString(hash, target);
+		for (; defines && defines->Name; defines++)
+		{
+			hashString(hash, defines->Name);
+			hashString(hash, defines->Definition ? defines->Definition : "");
+		}
+
+		const UINT key[] = { flags, D3D_COMPILER_VERSION };
+		for (size_t i = 0; i < sizeof(key); i++)
+		{
+			hash = (hash ^ reinterpret_cast<const unsigned char*>(key)[i]) * 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	std::string pathOf(UINT64 hash) const
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016llx.cso", static_cast<unsigned long long>(hash));
+		return m_directory + "/" + name;
+	}
+
+	// Written under a temporary name and renamed, so concurrent runs never map a partial file.
+	// Best effort, a read-only working directory only costs the disk cache.
+	static void store(const std::string& directory, const std::string& path, ID3DBlob* blob)
+	{
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+
+		const std::string temporary = path + "." + std::to_string(GetCurrentThreadId()) + ".tmp";
+		{
+			std::ofstream ofs(temporary, std::ios::binary | std::ios::trunc);
+			ofs.write(static_cast<const char*>(blob->GetBufferPointer()), static_cast<std::streamsize>(blob->GetBufferSize()));
+			if (!ofs) return;
+		}
+		std::filesystem::rename(temporary, path, error);
+		if (error) std::filesystem::remove(temporary, error);
+	}
+
+	std::string												m_directory = SHADER_CACHE_DIRECTORY;
+	std::unordered_map<UINT64, std::unique_ptr<Entry>>		m_entries;
+	std::unordered_map<std::string, D3D12_SHADER_BYTECODE>	m_embedded;
+	std::mutex												m_mutex;
+	UINT													m_memoryHits = 0;
+	UINT													m_diskHits = 0;
+	UINT													m_compiles = 0;
+	UINT													m_embeddedHits = 0;
+};
+
+#endif // SHADER_CACHE_H__
@@ -0,0 +1,268 @@
+#ifndef SHADER_HOT_RELOAD_H__
+#define SHADER_HOT_RELOAD_H__
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Windows.h>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+#include "deferred_release.h"
+#include "pipeline_builder.h"
+#include "shader_cache.h"
+
+// Editors save in several steps, rebuild once the directory has been quiet this long.
+const DWORD SHADER_RELOAD_DEBOUNCE_MS = 100;
+
+// Watches a shader directory with ReadDirectoryChangesW and rebuilds the pipelines whose source
+// files changed. Rebuilds go through the shader cache and pipeline builder, so compilation never
+// runs on the render thread; apply() swaps finished pipelines in at a frame boundary without waiting.
+//
+// A rebuild that fails to compile is reported and the previous pipeline stays bound.
+class ShaderHotReload
+{
+public:
+	~ShaderHotReload()
+	{
+		destroy();
+	}
+
+	void create(const std::string& directory)
+	{
+		m_directory = directory;
+		m_directoryHandle = CreateFileA(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+		if (m_directoryHandle == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error("Cannot watch shader directory " + directory);
+		}
+
+		m_changeEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+		m_stopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+		m_thread = std::thread([this]() { watch(); });
+	}
+
+	// Stops watching and drops all registrations, pipelines keep what they last swapped in.
+	void destroy() noexcept
+	{
+		if (m_thread.joinable())
+		{
+			SetEvent(m_stopEvent);
+			m_thread.join();
+		}
+		if (m_stopEvent) CloseHandle(m_stopEvent);
+		if (m_changeEvent) CloseHandle(m_changeEvent);
+		if (m_directoryHandle != INVALID_HANDLE_VALUE) CloseHandle(m_directoryHandle);
+		m_stopEvent = nullptr;
+		m_changeEvent = nullptr;
+		m_directoryHandle = INVALID_HANDLE_VALUE;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries.clear();
+	}
+
+	// Text of a file in the watched directory, for use inside build functions.
+	std::string source(const std::string& file) const
+	{
+		std::ifstream ifs(m_directory + "/" + file, std::ios::binary);
+		if (!ifs)
+		{
+			throw std::runtime_error("Cannot read shader " + file);
+		}
+
+		std::ostringstream text;
+		text << ifs.rdbuf();
+		return text.str();
+	}
+
+	// build() requests the shaders it needs and returns the pipeline future. It runs once now and
+	// again on the watcher thread whenever one of files changes, so it must only touch thread-safe state.
+	void add(PendingPipeline* pipeline, std::vector<std::string> files, std::function<PipelineFuture()> build)
+	{
+		auto entry = std::make_unique<Entry>();
+		entry->pipeline = pipeline;
+		entry->files = std::move(files);
+		entry->build = std::move(build);
+		*pipeline = entry->build();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries.push_back(std::move(entry));
+	}
+
+	// Call at a frame boundary on the render thread. Swaps in every finished rebuild and retires
+	// the pipeline it replaces at fenceValue. Returns the number of pipelines swapped.
+	UINT apply(DeferredReleaseQueue& deferredRelease, UINT64 fenceValue)
+	{
+		UINT swapped = 0;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const std::unique_ptr<Entry>& entry : m_entries)
+		{
+			if (!entry->pending.valid() || entry->pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) continue;
+
+			PipelineFuture pending = std::move(entry->pending);
+			entry->pending = {};
+			try
+			{
+				winrt::com_ptr<ID3D12PipelineState> previous = entry->pipeline->replace(pending.get());
+				deferredRelease.retire(previous, fenceValue);
+				swapped++;
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "Shader reload failed: " << e.what() << std::endl;
+			}
+			catch (const winrt::hresult_error& e)
+			{
+				std::cerr << "Shader reload failed: " << winrt::to_string(e.message()) << std::endl;
+			}
+		}
+		return swapped;
+	}
+
+private:
+	struct Entry
+	{
+		PendingPipeline*				pipeline = nullptr;
+		std::vector<std::string>		files;
+		std::function<PipelineFuture()>	build;
+		PipelineFuture					pending;
+	};
+
+	void watch()
+	{
+		std::vector<DWORD> buffer(16384 / sizeof(DWORD));
+		OVERLAPPED overlapped{};
+		overlapped.hEvent = m_changeEvent;
+
+		std::set<std::string> changed;
+		bool everything = false;
+		bool reading = false;
+		for (;;)
+		{
+			if (!reading)
+			{
+				ResetEvent(m_changeEvent);
+				if (!ReadDirectoryChangesW(m_directoryHandle, buffer.data(), static_cast<DWORD>(buffer.size() * sizeof(DWORD)), TRUE,
+					FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, nullptr, &overlapped, nullptr))
+				{
+					return;
+				}
+				reading = true;
+			}
+
+			const bool waiting = everything || !changed.empty();
+			HANDLE events[] = { m_stopEvent, m_changeEvent };
+			const DWORD result = WaitForMultipleObjects(_countof(events), events, FALSE, waiting ? SHADER_RELOAD_DEBOUNCE_MS : INFINITE);
+
+			DWORD bytes = 0;
+			if (result == WAIT_OBJECT_0)
+			{
+				CancelIoEx(m_directoryHandle, &overlapped);
+				GetOverlappedResult(m_directoryHandle, &overlapped, &bytes, TRUE);
+				return;
+			}
+			else if (result == WAIT_OBJECT_0 + 1)
+			{
+				reading = false;
+				if (!GetOverlappedResult(m_directoryHandle, &overlapped, &bytes, FALSE)) continue;
+
+				// Zero bytes means the notification buffer overflowed, assume every file changed.
+				if (bytes == 0)
+				{
+					everything = true;
+					continue;
+				}
+
+				const BYTE* cursor = reinterpret_cast<const BYTE*>(buffer.data());
+				for (;;)
+				{
+					const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(cursor);
+					changed.insert(narrow(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+					if (info->NextEntryOffset == 0) break;
+					cursor += info->NextEntryOffset;
+				}
+			}
+			else if (result == WAIT_TIMEOUT)
+			{
+				rebuild(changed, everything);
+				changed.clear();
+				everything = false;
+			}
+			else
+			{
+				return;
+			}
+		}
+	}
+
+	void rebuild(const std::set<std::string>& changed, bool everything)
+	{
+		std::vector<Entry*> affected;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (const std::unique_ptr<Entry>& entry : m_entries)
+			{
+				const bool hit = everything || std::any_of(entry->files.begin(), entry->files.end(),
+					[&changed](const std::string& file) { return changed.count(file) != 0; });
+				if (hit) affected.push_back(entry.get());
+			}
+		}
+
+		// Outside the lock, reading sources must not hold up apply().
+		for (Entry* entry : affected)
+		{
+			PipelineFuture pending;
+			try
+			{
+				pending = entry->build();
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "Shader reload failed: " << e.what() << std::endl;
+				continue;
+			}
+			catch (const winrt::hresult_error& e)
+			{
+				std::cerr << "Shader reload failed: " << winrt::to_string(e.message()) << std::endl;
+				continue;
+			}
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			entry->pending = std::move(pending);
+		}
+	}
+
+	static std::string narrow(const WCHAR* text, size_t length)
+	{
+		const int size = WideCharToMultiByte(CP_UTF8, 0, text, static_cast<int>(length), nullptr, 0, nullptr, nullptr);
+		std::string result(static_cast<size_t>(size), '\0');
+		WideCharToMultiByte(CP_UTF8, 0, text, static_cast<int>(length), result.data(), size, nullptr, nullptr);
+		std::replace(result.begin(), result.end(), '\\', '/');
+		return result;
+	}
+
+	std::string							m_directory;
+	HANDLE								m_directoryHandle = INVALID_HANDLE_VALUE;
+	HANDLE								m_changeEvent = nullptr;
+	HANDLE								m_stopEvent = nullptr;
+	std::thread							m_thread;
+	std::mutex							m_mutex;
+	std::vector<std::unique_ptr<Entry>>	m_entries;
+};
+
+#endif // SHADER_HOT_RELOAD_H__
@@ -0,0 +1,184 @@
+#ifndef SHADER_PERMUTATIONS_H__
+#define SHADER_PERMUTATIONS_H__
+
+#include <array>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <d3d12.h>
+
+#include "shader_cache.h"
+#include "shader_hot_reload.h"
+#include "pipeline_builder.h"
+
+// One bit per feature toggle of a shader family.
+using PermutationKey = UINT32;
+
+// Feature toggles of a shader family, declared once as a constexpr table of define names:
+//
+//   constexpr ShaderFeatures<2> MESH_FEATURES{ { "VERTEX_COLOR", "TEXTURED" } };
+//   constexpr PermutationKey MESH_TEXTURED = MESH_FEATURES.bit("TEXTURED");
+//
+// Every feature is defined in every permutation, 1 when its bit is set and 0 otherwise,
+// so shaders select code with #if and never branch on it at runtime.
+template <size_t N>
+struct ShaderFeatures
+{
+	static_assert(N > 0 && N <= 32, "A permutation key holds at most 32 features");
+
+	std::array<const char*, N>	names;
+
+	// A name that is not in the table fails to compile in a constant expression.
+	constexpr PermutationKey bit(const char* name) const
+	{
+		for (size_t i = 0; i < N; i++)
+		{
+			if (equal(names[i], name)) return PermutationKey(1) << i;
+		}
+		throw std::logic_error("Unknown shader feature");
+	}
+
+	constexpr PermutationKey all() const noexcept
+	{
+		return N == 32 ? ~PermutationKey(0) : (PermutationKey(1) << N) - 1;
+	}
+
+	// Null-terminated macro list for D3DCompile, pointing at the static name table.
+	std::vector<D3D_SHADER_MACRO> defines(PermutationKey key) const
+	{
+		std::vector<D3D_SHADER_MACRO> macros;
+		macros.reserve(N + 1);
+		for (size_t i = 0; i < N; i++)
+		{
+			macros.push_back({ names[i], (key >> i) & 1 ? "1" : "0" });
+		}
+		macros.push_back({ nullptr, nullptr });
+		return macros;
+	}
+
+private:
+	static constexpr bool equal(const char* a, const char* b) noexcept
+	{
+		for (; *a && *a == *b; a++, b++) {}
+		return *a == *b;
+	}
+};
+
+// Graphics pipelines of one shader family, created on first request of each permutation key.
+// Shaders are files under LEARN_DX_SHADER_DIR with a main entry point. Release builds take every
+// permutation from the bytecode embedded by the build; development builds compile the ones that
+// are not embedded, only when requested, and the shader cache keeps them on disk for later runs.
+//
+// With a hot reload watching LEARN_DX_SHADER_DIR, every requested permutation is compiled from the
+// current source instead and rebuilt whenever one of its files is saved. That needs runtime
+// compilation, development builds only.
+//
+// describe() fills in everything but the shaders for a key. Its input layout only has to outlive
+// the call, and with hot reload it also runs on the watcher thread. request() and get() belong to
+// the render thread, lookups are one hash-table probe.
+template <size_t N>
+class PipelinePermutations
+{
+public:
+	using Describe = std::function<void(PermutationKey, D3D12_GRAPHICS_PIPELINE_STATE_DESC&)>;
+
+	void create(const ShaderFeatures<N>& features, ShaderCache* shaderCache, PipelineBuilder* builder,
+		const char* vertexShaderFile, const char* pixelShaderFile, UINT compileFlags, Describe describe, ShaderHotReload* hotReload = nullptr)
+	{
+		m_features = &features;
+		m_shaderCache = shaderCache;
+		m_builder = builder;
+		m_vertexShaderFile = vertexShaderFile;
+		m_pixelShaderFile = pixelShaderFile;
+		m_compileFlags = compileFlags;
+		m_describe = std::move(describe);
+		m_hotReload = hotReload;
+		m_pipelines.clear();
+	}
+
+	// The hot reload must be destroyed first, it points at the pipelines.
+	void destroy() noexcept
+	{
+		m_pipelines.clear();
+		m_hotReload = nullptr;
+		m_describe = nullptr;
+		m_builder = nullptr;
+		m_shaderCache = nullptr;
+		m_features = nullptr;
+	}
+
+	// Starts building key in the background if it has not been requested yet.
+	PendingPipeline& request(PermutationKey key)
+	{
+		auto it = m_pipelines.find(key);
+		if (it != m_pipelines.end()) return it->second;
+
+		if (key & ~m_features->all())
+		{
+			throw std::runtime_error("Permutation key has bits beyond its feature table");
+		}
+
+		PendingPipeline& pipeline = m_pipelines[key];
+		try
+		{
+			if (m_hotReload)
+			{
+				m_hotReload->add(&pipeline, { m_vertexShaderFile, m_pixelShaderFile }, [this, key]() { return build(key); });
+			}
+			else
+			{
+				pipeline = build(key);
+			}
+		}
+		catch (...)
+		{
+			m_pipelines.erase(key);
+			throw;
+		}
+		return pipeline;
+	}
+
+	// Waits for the first use of a permutation that is still building.
+	ID3D12PipelineState* get(PermutationKey key)
+	{
+		return request(key).get();
+	}
+
+	size_t size() const noexcept { return m_pipelines.size(); }
+
+private:
+	PipelineFuture build(PermutationKey key) const
+	{
+		const std::vector<D3D_SHADER_MACRO> defines = m_features->defines(key);
+		ShaderFuture vertexShader;
+		ShaderFuture pixelShader;
+		if (m_hotReload)
+		{
+			vertexShader = m_shaderCache->request(m_hotReload->source(m_vertexShaderFile).c_str(), "main", "vs_5_0", m_compileFlags, defines.data());
+			pixelShader = m_shaderCache->request(m_hotReload->source(m_pixelShaderFile).c_str(), "main", "ps_5_0", m_compileFlags, defines.data());
+		}
+		else
+		{
+			vertexShader = m_shaderCache->requestFile(m_vertexShaderFile, "main", "vs_5_0", m_compileFlags, defines.data());
+			pixelShader = m_shaderCache->requestFile(m_pixelShaderFile, "main", "ps_5_0", m_compileFlags, defines.data());
+		}
+
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = {};
+		m_describe(key, desc);
+		return m_builder->build(desc, vertexShader, pixelShader);
+	}
+
+	const ShaderFeatures<N>*							m_features = nullptr;
+	ShaderCache*										m_shaderCache = nullptr;
+	PipelineBuilder*									m_builder = nullptr;
+	const char*											m_vertexShaderFile = nullptr;
+	const char*											m_pixelShaderFile = nullptr;
+	UINT												m_compileFlags = 0;
+	Describe											m_describe;
+	ShaderHotReload*									m_hotReload = nullptr;
+	std::unordered_map<PermutationKey, PendingPipeline>	m_pipelines;
+};
+
+#endif // SHADER_PERMUTATIONS_H__
@@ -0,0 +1,41 @@
+#ifndef SNAPSHOT_EXCHANGE_H__
+#define SNAPSHOT_EXCHANGE_H__
+
+#include <atomic>
+
+// Lock-free triple buffer handing frame snapshots from the simulation thread to the render thread.
+// The producer always has a slot to write and the consumer always reads the newest complete one.
+template<typename T>
+class SnapshotExchange
+{
+public:
+	// Producer side: fill back(), then publish() it.
+	T& back() noexcept { return m_slots[m_back]; }
+
+	void publish() noexcept
+	{
+		m_back = m_middle.exchange(m_back | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	// Consumer side: swap in the newest published snapshot, returns false if nothing new arrived.
+	bool acquire() noexcept
+	{
+		if ((m_middle.load(std::memory_order_relaxed) & FRESH_BIT) == 0) return false;
+
+		m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+
+	const T& front() const noexcept { return m_slots[m_front]; }
+
+private:
+	static constexpr unsigned INDEX_MASK = 3;
+	static constexpr unsigned FRESH_BIT = 4;
+
+	T						m_slots[3]{};
+	unsigned				m_back = 0;
+	unsigned				m_front = 1;
+	std::atomic<unsigned>	m_middle{ 2 };
+};
+
+#endif // SNAPSHOT_EXCHANGE_H__
@@ -0,0 +1,389 @@
+#ifndef STATE_FILTER_H__
+#define STATE_FILTER_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <d3d12.h>
+
+// Forwards state calls to a command list and drops the ones that would bind what is already bound:
+// pipeline, root signatures, descriptor heaps, root arguments, vertex and index buffers, topology,
+// viewports and scissor rects. Draws, dispatches and barriers go to list() directly.
+//
+// The filter only knows what went through it. Call reset() whenever the list is reset and
+// invalidate() after setting state on list() directly. Templated on the list so RecordingCommandList
+// below can stand in for ID3D12GraphicsCommandList where there is no device.
+template <typename CommandList = ID3D12GraphicsCommandList>
+class StateFilter
+{
+public:
+	StateFilter() = default;
+
+	explicit StateFilter(CommandList* commandList)
+	{
+		reset(commandList);
+	}
+
+	// Track commandList from its state right after Reset().
+	void reset(CommandList* commandList) noexcept
+	{
+		m_commandList = commandList;
+		invalidate();
+	}
+
+	// Forget everything, the next call of each kind is forwarded.
+	void invalidate() noexcept
+	{
+		m_pipeline.reset();
+		m_graphics = {};
+		m_compute = {};
+		m_descriptorHeapCount.reset();
+		m_vertexBufferKnown = 0;
+		m_indexBuffer.reset();
+		m_topology.reset();
+		m_viewportCount.reset();
+		m_scissorRectCount.reset();
+	}
+
+	CommandList* list() const noexcept { return m_commandList; }
+
+	void SetPipelineState(ID3D12PipelineState* pipeline)
+	{
+		if (same(m_pipeline, pipeline)) return;
+		m_commandList->SetPipelineState(pipeline);
+	}
+
+	// A new root signature leaves every root argument of its kind undefined.
+	void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature)
+	{
+		if (setRootSignature(m_graphics, rootSignature)) m_commandList->SetGraphicsRootSignature(rootSignature);
+	}
+
+	void SetComputeRootSignature(ID3D12RootSignature* rootSignature)
+	{
+		if (setRootSignature(m_compute, rootSignature)) m_commandList->SetComputeRootSignature(rootSignature);
+	}
+
+	// Changing heaps invalidates the descriptor tables bound from the old ones.
+	void SetDescriptorHeaps(UINT count, ID3D12DescriptorHeap* const* heaps)
+	{
+		if (count <= MAX_DESCRIPTOR_HEAPS && m_descriptorHeapCount == count && std::equal(heaps, heaps + count, m_descriptorHeaps))
+		{
+			m_filtered++;
+			return;
+		}
+
+		m_forwarded++;
+		m_descriptorHeapCount.reset();
+		if (count <= MAX_DESCRIPTOR_HEAPS)
+		{
+			m_descriptorHeapCount = count;
+			std::copy(heaps, heaps + count, m_descriptorHeaps);
+		}
+		forgetTables(m_graphics);
+		forgetTables(m_compute);
+		m_commandList->SetDescriptorHeaps(count, heaps);
+	}
+
+	void SetGraphicsRootDescriptorTable(UINT index, D3D12_GPU_DESCRIPTOR_HANDLE table)
+	{
+		if (setRootArgument(m_graphics, index, RootArgumentType::Table, table.ptr)) m_commandList->SetGraphicsRootDescriptorTable(index, table);
+	}
+
+	void SetComputeRootDescriptorTable(UINT index, D3D12_GPU_DESCRIPTOR_HANDLE table)
+	{
+		if (setRootArgument(m_compute, index, RootArgumentType::Table, table.ptr)) m_commandList->SetComputeRootDescriptorTable(index, table);
+	}
+
+	// Only a repeat of the last constant written to a parameter is dropped.
+	void SetGraphicsRoot32BitConstant(UINT index, UINT value, UINT offset)
+	{
+		if (setRootArgument(m_graphics, index, RootArgumentType::Constant, static_cast<UINT64>(offset) << 32 | value)) m_commandList->SetGraphicsRoot32BitConstant(index, value, offset);
+	}
+
+	void SetComputeRoot32BitConstant(UINT index, UINT value, UINT offset)
+	{
+		if (setRootArgument(m_compute, index, RootArgumentType::Constant, static_cast<UINT64>(offset) << 32 | value)) m_commandList->SetComputeRoot32BitConstant(index, value, offset);
+	}
+
+	void SetGraphicsRootConstantBufferView(UINT index, D3D12_GPU_VIRTUAL_ADDRESS address)
+	{
+		if (setRootArgument(m_graphics, index, RootArgumentType::ConstantBufferView, address)) m_commandList->SetGraphicsRootConstantBufferView(index, address);
+	}
+
+	void SetComputeRootConstantBufferView(UINT index, D3D12_GPU_VIRTUAL_ADDRESS address)
+	{
+		if (setRootArgument(m_compute, index, RootArgumentType::ConstantBufferView, address)) m_commandList->SetComputeRootConstantBufferView(index, address);
+	}
+
+	void SetGraphicsRootShaderResourceView(UINT index, D3D12_GPU_VIRTUAL_ADDRESS address)
+	{
+		if (setRootArgument(m_graphics, index, RootArgumentType::ShaderResourceView, address)) m_commandList->SetGraphicsRootShaderResourceView(index, address);
+	}
+
+	void SetComputeRootShaderResourceView(UINT index, D3D12_GPU_VIRTUAL_ADDRESS address)
+	{
+		if (setRootArgument(m_compute, index, RootArgumentType::ShaderResourceView, address)) m_commandList->SetComputeRootShaderResourceView(index, address);
+	}
+
+	void SetGraphicsRootUnorderedAccessView(UINT index, D3D12_GPU_VIRTUAL_ADDRESS address)
+	{
+		if (setRootArgument(m_graphics, index, RootArgumentType::UnorderedAccessView, address)) m_commandList->SetGraphicsRootUnorderedAccessView(index, address);
+	}
+
+	void SetComputeRootUnorderedAccessView(UINT index, D3D12_GPU_VIRTUAL_ADDRESS address)
+	{
+		if (setRootArgument(m_compute, index, RootArgumentType::UnorderedAccessView, address)) m_commandList->SetComputeRootUnorderedAccessView(index, address);
+	}
+
+	// Dropped only when every slot in the range already holds the same view.
+	void IASetVertexBuffers(UINT startSlot, UINT count, const D3D12_VERTEX_BUFFER_VIEW* views)
+	{
+		const bool tracked = views && startSlot + count <= D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT;
+		if (tracked)
+		{
+			bool bound = true;
+			for (UINT i = 0; i < count && bound; i++)
+			{
+				const UINT slot = startSlot + i;
+				bound = (m_vertexBufferKnown >> slot & 1) && std::memcmp(&m_vertexBuffers[slot], &views[i], sizeof(D3D12_VERTEX_BUFFER_VIEW)) == 0;
+			}
+			if (bound)
+			{
+				m_filtered++;
+				return;
+			}
+		}
+
+		m_forwarded++;
+		for (UINT i = 0; i < count && startSlot + i < D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT; i++)
+		{
+			const UINT slot = startSlot + i;
+			if (tracked)
+			{
+				m_vertexBuffers[slot] = views[i];
+				m_vertexBufferKnown |= 1U << slot;
+			}
+			else
+			{
+				m_vertexBufferKnown &= ~(1U << slot);
+			}
+		}
+		m_commandList->IASetVertexBuffers(startSlot, count, views);
+	}
+
+	void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view)
+	{
+		if (view && m_indexBuffer && std::memcmp(&*m_indexBuffer, view, sizeof(D3D12_INDEX_BUFFER_VIEW)) == 0)
+		{
+			m_filtered++;
+			return;
+		}
+
+		m_forwarded++;
+		m_indexBuffer.reset();
+		if (view) m_indexBuffer = *view;
+		m_commandList->IASetIndexBuffer(view);
+	}
+
+	void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology)
+	{
+		if (same(m_topology, topology)) return;
+		m_commandList->IASetPrimitiveTopology(topology);
+	}
+
+	void RSSetViewports(UINT count, const D3D12_VIEWPORT* viewports)
+	{
+		if (setRects(m_viewportCount, m_viewports, count, viewports)) m_commandList->RSSetViewports(count, viewports);
+	}
+
+	void RSSetScissorRects(UINT count, const D3D12_RECT* rects)
+	{
+		if (setRects(m_scissorRectCount, m_scissorRects, count, rects)) m_commandList->RSSetScissorRects(count, rects);
+	}
+
+	UINT64 forwarded() const noexcept { return m_forwarded; }
+	UINT64 filtered() const noexcept { return m_filtered; }
+
+private:
+	static const UINT MAX_DESCRIPTOR_HEAPS = 2;
+	static const UINT MAX_ROOT_ARGUMENTS = 64;
+	static const UINT MAX_RECTS = D3D12_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+
+	enum class RootArgumentType : UINT
+	{
+		Unknown,
+		Table,
+		Constant,
+		ConstantBufferView,
+		ShaderResourceView,
+		UnorderedAccessView
+	};
+
+	struct RootArgument
+	{
+		RootArgumentType	type = RootArgumentType::Unknown;
+		UINT64				value = 0;
+	};
+
+	// Root signature and arguments of one kind, graphics and compute bind independently.
+	struct RootState
+	{
+		std::optional<ID3D12RootSignature*>	rootSignature;
+		RootArgument						arguments[MAX_ROOT_ARGUMENTS];
+	};
+
+	template <typename T>
+	bool same(std::optional<T>& bound, T value) noexcept
+	{
+		if (bound == value)
+		{
+			m_filtered++;
+			return true;
+		}
+
+		m_forwarded++;
+		bound = value;
+		return false;
+	}
+
+	bool setRootSignature(RootState& state, ID3D12RootSignature* rootSignature) noexcept
+	{
+		if (same(state.rootSignature, rootSignature)) return false;
+
+		std::fill(std::begin(state.arguments), std::end(state.arguments), RootArgument{});
+		return true;
+	}
+
+	bool setRootArgument(RootState& state, UINT index, RootArgumentType type, UINT64 value) noexcept
+	{
+		if (index >= MAX_ROOT_ARGUMENTS)
+		{
+			m_forwarded++;
+			return true;
+		}
+
+		RootArgument& argument = state.arguments[index];
+		if (argument.type == type && argument.value == value)
+		{
+			m_filtered++;
+			return false;
+		}
+
+		m_forwarded++;
+		argument.type = type;
+		argument.value = value;
+		return true;
+	}
+
+	static void forgetTables(RootState& state) noexcept
+	{
+		for (RootArgument& argument : state.arguments)
+		{
+			if (argument.type == RootArgumentType::Table) argument = {};
+		}
+	}
+
+	template <typename T>
+	bool setRects(std::optional<UINT>& boundCount, T (&bound)[MAX_RECTS], UINT count, const T* rects) noexcept
+	{
+		if (count <= MAX_RECTS && boundCount == count && std::memcmp(bound, rects, count * sizeof(T)) == 0)
+		{
+			m_filtered++;
+			return false;
+		}
+
+		m_forwarded++;
+		boundCount.reset();
+		if (count <= MAX_RECTS)
+		{
+			boundCount = count;
+			std::copy(rects, rects + count, bound);
+		}
+		return true;
+	}
+
+	CommandList*							m_commandList = nullptr;
+	std::optional<ID3D12PipelineState*>		m_pipeline;
+	RootState								m_graphics;
+	RootState								m_compute;
+	std::optional<UINT>						m_descriptorHeapCount;
+	ID3D12DescriptorHeap*					m_descriptorHeaps[MAX_DESCRIPTOR_HEAPS] = {};
+	D3D12_VERTEX_BUFFER_VIEW				m_vertexBuffers[D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT] = {};
+	UINT									m_vertexBufferKnown = 0;
+	std::optional<D3D12_INDEX_BUFFER_VIEW>	m_indexBuffer;
+	std::optional<D3D12_PRIMITIVE_TOPOLOGY>	m_topology;
+	std::optional<UINT>						m_viewportCount;
+	D3D12_VIEWPORT							m_viewports[MAX_RECTS] = {};
+	std::optional<UINT>						m_scissorRectCount;
+	D3D12_RECT								m_scissorRects[MAX_RECTS] = {};
+	UINT64									m_forwarded = 0;
+	UINT64									m_filtered = 0;
+};
+
+// Stand-in for ID3D12GraphicsCommandList that records every state call it receives with its
+// arguments, so what a StateFilter lets through can be checked without a GPU. Calls are written as
+// "Name(arg, ...)": pointers, handles and addresses as integers, arrays and structs in braces.
+struct RecordingCommandList
+{
+	std::vector<std::string>	calls;
+
+	void SetPipelineState(ID3D12PipelineState* pipeline) { record("SetPipelineState", pipeline); }
+	void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature) { record("SetGraphicsRootSignature", rootSignature); }
+	void SetComputeRootSignature(ID3D12RootSignature* rootSignature) { record("SetComputeRootSignature", rootSignature); }
+	void SetDescriptorHeaps(UINT count, ID3D12DescriptorHeap* const* heaps) { record("SetDescriptorHeaps", count, list(heaps, count)); }
+	void SetGraphicsRootDescriptorTable(UINT index, D3D12_GPU_DESCRIPTOR_HANDLE table) { record("SetGraphicsRootDescriptorTable", index, table.ptr); }
+	void SetComputeRootDescriptorTable(UINT index, D3D12_GPU_DESCRIPTOR_HANDLE table) { record("SetComputeRootDescriptorTable", index, table.ptr); }
+	void SetGraphicsRoot32BitConstant(UINT index, UINT value, UINT offset) { record("SetGraphicsRoot32BitConstant", index, value, offset); }
+	void SetComputeRoot32BitConstant(UINT index, UINT value, UINT offset) { record("SetComputeRoot32BitConstant", index, value, offset); }
+	void SetGraphicsRootConstantBufferView(UINT index, D3D12_GPU_VIRTUAL_ADDRESS address) { record("SetGraphicsRootConstantBufferView", index, address); }
+	void SetComputeRootConstantBufferView(UINT index, D3D12_GPU_VIRTUAL_ADDRESS address) { record("SetComputeRootConstantBufferView", index, address); }
+	void SetGraphicsRootShaderResourceView(UINT index, D3D12_GPU_VIRTUAL_ADDRESS address) { record("SetGraphicsRootShaderResourceView", index, address); }
+	void SetComputeRootShaderResourceView(UINT index, D3D12_GPU_VIRTUAL_ADDRESS address) { record("SetComputeRootShaderResourceView", index, address); }
+	void SetGraphicsRootUnorderedAccessView(UINT index, D3D12_GPU_VIRTUAL_ADDRESS address) { record("SetGraphicsRootUnorderedAccessView", index, address); }
+	void SetComputeRootUnorderedAccessView(UINT index, D3D12_GPU_VIRTUAL_ADDRESS address) { record("SetComputeRootUnorderedAccessView", index, address); }
+	void IASetVertexBuffers(UINT startSlot, UINT count, const D3D12_VERTEX_BUFFER_VIEW* views) { record("IASetVertexBuffers", startSlot, count, list(views, views ? count : 0)); }
+	void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view) { record("IASetIndexBuffer", list(view, view ? 1 : 0)); }
+	void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology) { record("IASetPrimitiveTopology", static_cast<UINT>(topology)); }
+	void RSSetViewports(UINT count, const D3D12_VIEWPORT* viewports) { record("RSSetViewports", count, list(viewports, count)); }
+	void RSSetScissorRects(UINT count, const D3D12_RECT* rects) { record("RSSetScissorRects", count, list(rects, count)); }
+
+private:
+	template <typename... Args>
+	void record(const char* name, const Args&... args)
+	{
+		std::string call = std::string(name) + "(";
+		const char* separator = "";
+		((call += separator, call += format(args), separator = ", "), ...);
+		calls.push_back(call + ")");
+	}
+
+	template <typename T>
+	static std::string list(const T* values, UINT count)
+	{
+		std::string text = "{";
+		for (UINT i = 0; i < count; i++)
+		{
+			text += (i ? ", " : "") + format(values[i]);
+		}
+		return text + "}";
+	}
+
+	static std::string format(const std::string& text) { return text; }
+	static std::string format(UINT value) { return std::to_string(value); }
+	static std::string format(UINT64 value) { return std::to_string(value); }
+	static std::string format(float value) { return std::to_string(value); }
+	static std::string format(LONG value) { return std::to_string(value); }
+	static std::string format(const void* pointer) { return std::to_string(reinterpret_cast<uintptr_t>(pointer)); }
+	static std::string format(const D3D12_VERTEX_BUFFER_VIEW& view) { return "{" + format(view.BufferLocation) + ", " + format(view.SizeInBytes) + ", " + format(view.StrideInBytes) + "}"; }
+	static std::string format(const D3D12_INDEX_BUFFER_VIEW& view) { return "{" + format(view.BufferLocation) + ", " + format(view.SizeInBytes) + ", " + format(static_cast<UINT>(view.Format)) + "}"; }
+	static std::string format(const D3D12_VIEWPORT& viewport) { return "{" + format(viewport.TopLeftX) + ", " + format(viewport.TopLeftY) + ", " + format(viewport.Width) + ", " + format(viewport.Height) + ", " + format(viewport.MinDepth) + ", " + format(viewport.MaxDepth) + "}"; }
+	static std::string format(const D3D12_RECT& rect) { return "{" + format(rect.left) + ", " + format(rect.top) + ", " + format(rect.right) + ", " + format(rect.bottom) + "}"; }
+};
+
+#endif // STATE_FILTER_H__
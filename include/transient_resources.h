@@ -0,0 +1,257 @@
+#ifndef TRANSIENT_RESOURCES_H__
+#define TRANSIENT_RESOURCES_H__
+
+#include <algorithm>
+#include <vector>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+#include "d3dx12.h"
+#include "deferred_release.h"
+
+// Render targets, depth buffers and UAV buffers that only live between two passes of a frame.
+// Resources whose pass ranges do not overlap are placed at the same heap offset, and activate()
+// inserts the aliasing barrier and discard that hand the memory over at first use each frame.
+//
+// Usage: declare() everything, compile(), then per frame activate() each resource in its first
+// pass and transition() it between passes. Declare again after reset() when sizes change.
+class TransientResourcePool
+{
+public:
+	void create(ID3D12Device* device)
+	{
+		m_device.copy_from(device);
+		m_resources.clear();
+	}
+
+	void destroy() noexcept
+	{
+		m_resources.clear();
+		for (Group& group : m_groups)
+		{
+			group.heap = nullptr;
+			group.size = 0;
+		}
+		m_device = nullptr;
+	}
+
+	// The resource is live from the start of firstPass to the end of lastPass.
+	UINT declare(const D3D12_RESOURCE_DESC& desc, const D3D12_CLEAR_VALUE* clearValue, UINT firstPass, UINT lastPass)
+	{
+		Resource resource;
+		resource.desc = desc;
+		resource.hasClearValue = clearValue != nullptr;
+		if (clearValue) resource.clearValue = *clearValue;
+		resource.firstPass = firstPass;
+		resource.lastPass = lastPass;
+		m_resources.push_back(resource);
+		return static_cast<UINT>(m_resources.size() - 1);
+	}
+
+	// Retire the current heaps and resources at fenceValue and drop all declarations.
+	void reset(DeferredReleaseQueue& deferredRelease, UINT64 fenceValue)
+	{
+		for (Resource& resource : m_resources)
+		{
+			deferredRelease.retire(resource.resource, fenceValue);
+		}
+		for (Group& group : m_groups)
+		{
+			deferredRelease.retire(group.heap, fenceValue);
+			group.size = 0;
+		}
+		m_resources.clear();
+	}
+
+	// Pack the declared resources into one heap per heap category and create them.
+	void compile()
+	{
+		for (Resource& resource : m_resources)
+		{
+			const D3D12_RESOURCE_ALLOCATION_INFO info = m_device->GetResourceAllocationInfo(0, 1, &resource.desc);
+			resource.size = info.SizeInBytes;
+			resource.alignment = info.Alignment;
+			resource.group = groupOf(resource.desc);
+			resource.homeState = homeStateOf(resource.desc);
+		}
+
+		for (UINT g = 0; g < GROUP_COUNT; g++)
+		{
+			pack(static_cast<GroupType>(g));
+		}
+
+		for (Resource& resource : m_resources)
+		{
+			winrt::check_hresult(m_device->CreatePlacedResource(
+				m_groups[resource.group].heap.get(),
+				resource.offset,
+				&resource.desc,
+				resource.homeState,
+				resource.hasClearValue ? &resource.clearValue : nullptr,
+				IID_ID3D12Resource,
+				resource.resource.put_void()
+			));
+			resource.state = resource.homeState;
+		}
+	}
+
+	ID3D12Resource* resource(UINT handle) const noexcept { return m_resources[handle].resource.get(); }
+
+	// Take over the memory at first use this frame. Contents are undefined afterwards,
+	// render targets and depth buffers are discarded as aliasing requires.
+	void activate(ID3D12GraphicsCommandList* commandList, UINT handle)
+	{
+		Resource& resource = m_resources[handle];
+
+		D3D12_RESOURCE_BARRIER barriers[2];
+		UINT barrierCount = 0;
+		barriers[barrierCount++] = CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, resource.resource.get());
+		if (resource.state != resource.homeState)
+		{
+			barriers[barrierCount++] = CD3DX12_RESOURCE_BARRIER::Transition(resource.resource.get(), resource.state, resource.homeState);
+			resource.state = resource.homeState;
+		}
+		commandList->ResourceBarrier(barrierCount, barriers);
+
+		if (resource.desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+		{
+			commandList->DiscardResource(resource.resource.get(), nullptr);
+		}
+	}
+
+	void transition(ID3D12GraphicsCommandList* commandList, UINT handle, D3D12_RESOURCE_STATES state)
+	{
+		Resource& resource = m_resources[handle];
+		if (resource.state == state) return;
+
+		D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(resource.resource.get(), resource.state, state);
+		commandList->ResourceBarrier(1, &barrier);
+		resource.state = state;
+	}
+
+	// Heap memory in use versus what the same resources would take unaliased.
+	UINT64 heapBytes() const noexcept
+	{
+		UINT64 bytes = 0;
+		for (const Group& group : m_groups) bytes += group.size;
+		return bytes;
+	}
+
+	UINT64 unaliasedBytes() const noexcept
+	{
+		UINT64 bytes = 0;
+		for (const Resource& resource : m_resources) bytes += resource.size;
+		return bytes;
+	}
+
+private:
+	// Resource heap tier 1 cannot mix these in one heap.
+	enum GroupType : UINT
+	{
+		GROUP_BUFFERS,
+		GROUP_TARGETS,
+		GROUP_TEXTURES,
+		GROUP_COUNT
+	};
+
+	struct Resource
+	{
+		D3D12_RESOURCE_DESC				desc{};
+		D3D12_CLEAR_VALUE				clearValue{};
+		bool							hasClearValue = false;
+		UINT							firstPass = 0;
+		UINT							lastPass = 0;
+
+		UINT64							size = 0;
+		UINT64							alignment = 0;
+		UINT64							offset = 0;
+		GroupType						group = GROUP_BUFFERS;
+		D3D12_RESOURCE_STATES			homeState = D3D12_RESOURCE_STATE_COMMON;
+		D3D12_RESOURCE_STATES			state = D3D12_RESOURCE_STATE_COMMON;
+		winrt::com_ptr<ID3D12Resource>	resource;
+	};
+
+	struct Group
+	{
+		winrt::com_ptr<ID3D12Heap>	heap;
+		UINT64						size = 0;
+	};
+
+	static GroupType groupOf(const D3D12_RESOURCE_DESC& desc) noexcept
+	{
+		if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER) return GROUP_BUFFERS;
+		if (desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) return GROUP_TARGETS;
+		return GROUP_TEXTURES;
+	}
+
+	// The state a resource is activated in, the one DiscardResource accepts for it.
+	static D3D12_RESOURCE_STATES homeStateOf(const D3D12_RESOURCE_DESC& desc) noexcept
+	{
+		if (desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET) return D3D12_RESOURCE_STATE_RENDER_TARGET;
+		if (desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL) return D3D12_RESOURCE_STATE_DEPTH_WRITE;
+		if (desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS) return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		return D3D12_RESOURCE_STATE_COMMON;
+	}
+
+	static D3D12_HEAP_FLAGS heapFlagsOf(GroupType group) noexcept
+	{
+		switch (group)
+		{
+		case GROUP_BUFFERS: return D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+		case GROUP_TARGETS: return D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+		default: return D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+		}
+	}
+
+	// Greedy interval packing: largest first, each at the lowest offset that does not collide
+	// with an already placed resource whose pass range overlaps.
+	void pack(GroupType groupType)
+	{
+		std::vector<Resource*> order;
+		for (Resource& resource : m_resources)
+		{
+			if (resource.group == groupType) order.push_back(&resource);
+		}
+		if (order.empty()) return;
+
+		std::sort(order.begin(), order.end(), [](const Resource* a, const Resource* b) { return a->size > b->size; });
+
+		std::vector<Resource*> placed;
+		std::vector<Resource*> conflicts;
+		UINT64 heapSize = 0;
+		for (Resource* resource : order)
+		{
+			conflicts.clear();
+			for (Resource* other : placed)
+			{
+				if (resource->firstPass <= other->lastPass && other->firstPass <= resource->lastPass) conflicts.push_back(other);
+			}
+			std::sort(conflicts.begin(), conflicts.end(), [](const Resource* a, const Resource* b) { return a->offset < b->offset; });
+
+			UINT64 offset = 0;
+			for (Resource* other : conflicts)
+			{
+				if (offset + resource->size <= other->offset) break;
+				offset = (std::max)(offset, (other->offset + other->size + resource->alignment - 1) & ~(resource->alignment - 1));
+			}
+
+			resource->offset = offset;
+			heapSize = (std::max)(heapSize, offset + resource->size);
+			placed.push_back(resource);
+		}
+
+		Group& group = m_groups[groupType];
+		group.size = heapSize;
+
+		CD3DX12_HEAP_DESC heapDesc(heapSize, D3D12_HEAP_TYPE_DEFAULT, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, heapFlagsOf(groupType));
+		winrt::check_hresult(m_device->CreateHeap(&heapDesc, IID_ID3D12Heap, group.heap.put_void()));
+	}
+
+	winrt::com_ptr<ID3D12Device>	m_device;
+	std::vector<Resource>			m_resources;
+	Group							m_groups[GROUP_COUNT];
+};
+
+#endif // TRANSIENT_RESOURCES_H__
@@ -0,0 +1,149 @@
+#ifndef UPLOAD_RING_H__
+#define UPLOAD_RING_H__
+
+#include <deque>
+#include <stdexcept>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+#include "d3dx12.h"
+#include "frame_ring.h"
+
+const UINT64 UPLOAD_RING_SIZE = 16 * 1024 * 1024;
+
+struct UploadAllocation
+{
+	ID3D12Resource*				resource = nullptr;
+	UINT64						offset = 0;
+	UINT8*						cpuAddress = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS	gpuAddress = 0;
+};
+
+// Persistently mapped linear ring in UPLOAD memory. Suballocations are handed out at the head,
+// stamped with a value on the frame ring timeline by retire() and reclaimed by collect().
+class UploadRing
+{
+public:
+	void create(ID3D12Device* device, FrameRing* frameRing, UINT64 size = UPLOAD_RING_SIZE)
+	{
+		m_frameRing = frameRing;
+		m_size = size;
+		m_head = 0;
+		m_used = 0;
+		m_pendingBytes = 0;
+		m_retired.clear();
+
+		winrt::check_hresult(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(m_size),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_ID3D12Resource,
+			m_buffer.put_void()
+		));
+
+		CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
+		winrt::check_hresult(m_buffer->Map(0, &readRange, reinterpret_cast<void**>(&m_cpuAddress)));
+		m_gpuAddress = m_buffer->GetGPUVirtualAddress();
+	}
+
+	void destroy() noexcept
+	{
+		m_buffer = nullptr;
+		m_cpuAddress = nullptr;
+		m_gpuAddress = 0;
+		m_retired.clear();
+	}
+
+	ID3D12Resource* resource() const noexcept { return m_buffer.get(); }
+
+	// Waits on the oldest retired block when the ring is full, never allocates from the driver.
+	UploadAllocation allocate(UINT64 size, UINT64 alignment)
+	{
+		if (size + alignment > m_size)
+		{
+			throw std::runtime_error("Allocation larger than upload ring");
+		}
+
+		UINT64 offset = 0;
+		UINT64 needed = 0;
+		for (;;)
+		{
+			// An empty ring restarts at zero so anything that passed the size check fits.
+			if (m_used == 0) m_head = 0;
+
+			offset = (m_head + alignment - 1) & ~(alignment - 1);
+			if (offset + size > m_size)
+			{
+				// Skip the tail end of the buffer and start over at zero.
+				offset = 0;
+				needed = (m_size - m_head) + size;
+			}
+			else
+			{
+				needed = (offset - m_head) + size;
+			}
+
+			if (m_used + needed <= m_size) break;
+
+			if (m_retired.empty())
+			{
+				throw std::runtime_error("Upload ring exhausted by unsubmitted allocations");
+			}
+			m_frameRing->wait(m_retired.front().fenceValue);
+			collect(m_frameRing->completedValue());
+		}
+
+		m_head = (offset + size) % m_size;
+		m_used += needed;
+		m_pendingBytes += needed;
+
+		UploadAllocation allocation;
+		allocation.resource = m_buffer.get();
+		allocation.offset = offset;
+		allocation.cpuAddress = m_cpuAddress + offset;
+		allocation.gpuAddress = m_gpuAddress + offset;
+		return allocation;
+	}
+
+	// Everything allocated since the last retire() is free once fenceValue completes.
+	void retire(UINT64 fenceValue)
+	{
+		if (m_pendingBytes == 0) return;
+
+		m_retired.push_back({ fenceValue, m_pendingBytes });
+		m_pendingBytes = 0;
+	}
+
+	void collect(UINT64 completedValue) noexcept
+	{
+		while (!m_retired.empty() && m_retired.front().fenceValue <= completedValue)
+		{
+			m_used -= m_retired.front().bytes;
+			m_retired.pop_front();
+		}
+	}
+
+private:
+	struct Retired
+	{
+		UINT64 fenceValue;
+		UINT64 bytes;
+	};
+
+	FrameRing*						m_frameRing = nullptr;
+	winrt::com_ptr<ID3D12Resource>	m_buffer;
+	UINT8*							m_cpuAddress = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS		m_gpuAddress = 0;
+
+	UINT64							m_size = 0;
+	UINT64							m_head = 0;
+	UINT64							m_used = 0;
+	UINT64							m_pendingBytes = 0;
+	std::deque<Retired>				m_retired;
+};
+
+#endif // UPLOAD_RING_H__
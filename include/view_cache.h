@@ -0,0 +1,187 @@
+#ifndef VIEW_CACHE_H__
+#define VIEW_CACHE_H__
+
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include <winrt/base.h>
+
+#include <d3d12.h>
+
+#include "deferred_release.h"
+#include "descriptor_allocator.h"
+
+// Hash-consed SRV/UAV descriptors: one staging descriptor per (resource, view description).
+// Asking for a view that already exists returns the existing descriptor instead of creating it again.
+//
+// Descriptions are compared bytewise, zero-initialize them (= {}) before filling them in.
+// The cache holds a reference to every resource it has views of, so an address is never reused
+// while it is a key. Retiring a resource through the queue given to create() drops its views and
+// recycles their slots; release() does the same for resources that are not retired.
+class ViewCache
+{
+public:
+	void create(ID3D12Device* device, StagingDescriptorHeap* heap, DeferredReleaseQueue* deferredRelease = nullptr)
+	{
+		m_device.copy_from(device);
+		m_heap = heap;
+		m_deferredRelease = deferredRelease;
+		if (m_deferredRelease)
+		{
+			m_deferredRelease->listen(this, [this](::IUnknown* object)
+			{
+				winrt::com_ptr<ID3D12Resource> resource;
+				if (SUCCEEDED(object->QueryInterface(IID_ID3D12Resource, resource.put_void()))) release(resource.get());
+			});
+		}
+		m_views.clear();
+		m_resourceViews.clear();
+		m_hits = 0;
+		m_misses = 0;
+	}
+
+	void destroy() noexcept
+	{
+		if (m_deferredRelease) m_deferredRelease->unlisten(this);
+		m_deferredRelease = nullptr;
+		m_views.clear();
+		m_resourceViews.clear();
+		m_heap = nullptr;
+		m_device = nullptr;
+	}
+
+	// desc may be null for the resource's default view.
+	DescriptorHandle srv(ID3D12Resource* resource, const D3D12_SHADER_RESOURCE_VIEW_DESC* desc)
+	{
+		Key key = makeKey(ViewType::Srv, resource, nullptr, desc, desc ? sizeof(*desc) : 0);
+		DescriptorHandle* cached = find(key);
+		if (cached) return *cached;
+
+		DescriptorHandle handle = m_heap->allocate();
+		m_device->CreateShaderResourceView(resource, desc, handle.cpu);
+		return insert(key, handle);
+	}
+
+	DescriptorHandle uav(ID3D12Resource* resource, ID3D12Resource* counterResource, const D3D12_UNORDERED_ACCESS_VIEW_DESC* desc)
+	{
+		Key key = makeKey(ViewType::Uav, resource, counterResource, desc, desc ? sizeof(*desc) : 0);
+		DescriptorHandle* cached = find(key);
+		if (cached) return *cached;
+
+		DescriptorHandle handle = m_heap->allocate();
+		m_device->CreateUnorderedAccessView(resource, counterResource, desc, handle.cpu);
+		return insert(key, handle);
+	}
+
+	// Drop every view of resource and return its slots to the staging heap.
+	void release(ID3D12Resource* resource)
+	{
+		auto it = m_resourceViews.find(resource);
+		if (it == m_resourceViews.end()) return;
+
+		for (const Key& key : it->second.keys)
+		{
+			auto view = m_views.find(key);
+			if (view == m_views.end()) continue;
+
+			m_heap->free(view->second);
+			m_views.erase(view);
+		}
+		m_resourceViews.erase(it);
+	}
+
+	size_t size() const noexcept { return m_views.size(); }
+	UINT64 hits() const noexcept { return m_hits; }
+	UINT64 misses() const noexcept { return m_misses; }
+
+private:
+	enum class ViewType : UINT
+	{
+		Srv,
+		Uav
+	};
+
+	static constexpr size_t DESC_BYTES = sizeof(D3D12_SHADER_RESOURCE_VIEW_DESC) > sizeof(D3D12_UNORDERED_ACCESS_VIEW_DESC)
+		? sizeof(D3D12_SHADER_RESOURCE_VIEW_DESC) : sizeof(D3D12_UNORDERED_ACCESS_VIEW_DESC);
+
+	struct Key
+	{
+		ID3D12Resource*		resource = nullptr;
+		ID3D12Resource*		counterResource = nullptr;
+		ViewType			type = ViewType::Srv;
+		bool				hasDesc = false;
+		unsigned char		desc[DESC_BYTES] = {};
+
+		bool operator==(const Key& other) const noexcept
+		{
+			return resource == other.resource && counterResource == other.counterResource &&
+				type == other.type && hasDesc == other.hasDesc && memcmp(desc, other.desc, DESC_BYTES) == 0;
+		}
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const noexcept
+		{
+			// FNV-1a over the description, seeded with the resource pointers.
+			size_t hash = std::hash<const void*>()(key.resource) ^ (std::hash<const void*>()(key.counterResource) << 1);
+			hash ^= static_cast<size_t>(key.type) << 2 | static_cast<size_t>(key.hasDesc) << 3;
+			for (size_t i = 0; i < DESC_BYTES; i++)
+			{
+				hash = (hash ^ key.desc[i]) * 1099511628211ULL;
+			}
+			return hash;
+		}
+	};
+
+	static Key makeKey(ViewType type, ID3D12Resource* resource, ID3D12Resource* counterResource, const void* desc, size_t descSize) noexcept
+	{
+		Key key;
+		key.resource = resource;
+		key.counterResource = counterResource;
+		key.type = type;
+		key.hasDesc = desc != nullptr;
+		if (desc) memcpy(key.desc, desc, descSize);
+		return key;
+	}
+
+	DescriptorHandle* find(const Key& key) noexcept
+	{
+		auto it = m_views.find(key);
+		if (it == m_views.end())
+		{
+			m_misses++;
+			return nullptr;
+		}
+
+		m_hits++;
+		return &it->second;
+	}
+
+	DescriptorHandle insert(const Key& key, const DescriptorHandle& handle)
+	{
+		m_views.emplace(key, handle);
+		ResourceViews& views = m_resourceViews[key.resource];
+		if (!views.resource) views.resource.copy_from(key.resource);
+		views.keys.push_back(key);
+		return handle;
+	}
+
+	struct ResourceViews
+	{
+		winrt::com_ptr<ID3D12Resource>	resource;
+		std::vector<Key>				keys;
+	};
+
+	winrt::com_ptr<ID3D12Device>										m_device;
+	StagingDescriptorHeap*												m_heap = nullptr;
+	DeferredReleaseQueue*												m_deferredRelease = nullptr;
+	std::unordered_map<Key, DescriptorHandle, KeyHash>					m_views;
+	std::unordered_map<ID3D12Resource*, ResourceViews>					m_resourceViews;
+	UINT64																m_hits = 0;
+	UINT64																m_misses = 0;
+};
+
+#endif // VIEW_CACHE_H__
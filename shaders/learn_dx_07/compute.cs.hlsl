@@ -0,0 +1,24 @@
+static const uint3 gl_WorkGroupSize = uint3(1u, 1u, 1u);
+
+StructuredBuffer<float4> _34 : register(t0);
+RWStructuredBuffer<float4> _48 : register(u0);
+
+static uint3 gl_GlobalInvocationID;
+struct SPIRV_Cross_Input
+{
+	uint3 gl_GlobalInvocationID : SV_DispatchThreadID;
+};
+
+void comp_main()
+{
+	uint idx = (gl_GlobalInvocationID.y * 3 * gl_WorkGroupSize.x) + gl_GlobalInvocationID.x;
+	float3 p = _34[idx].xyz;
+	_48[idx] = float4(p.x + 0.001000000047497451305389404296875f, p.y, 0.0f, 1.0f);
+}
+
+[numthreads(1, 1, 1)]
+void main(SPIRV_Cross_Input stage_input)
+{
+	gl_GlobalInvocationID = stage_input.gl_GlobalInvocationID;
+	comp_main();
+}
@@ -0,0 +1,19 @@
+static float4 FragColor;
+
+struct SPIRV_Cross_Output
+{
+	float4 FragColor : SV_Target0;
+};
+
+void frag_main()
+{
+	FragColor = float4(1.0f, 0.0f, 0.0f, 1.0f);
+}
+
+SPIRV_Cross_Output main()
+{
+	frag_main();
+	SPIRV_Cross_Output stage_output;
+	stage_output.FragColor = FragColor;
+	return stage_output;
+}
@@ -0,0 +1,26 @@
+static float4 gl_Position;
+static float4 aPos;
+
+struct SPIRV_Cross_Input
+{
+	float4 aPos : POSITION0;
+};
+
+struct SPIRV_Cross_Output
+{
+	float4 gl_Position : SV_Position;
+};
+
+void vert_main()
+{
+	gl_Position = float4(aPos.xy, 0.0f, 1.0f);
+}
+
+SPIRV_Cross_Output main(SPIRV_Cross_Input stage_input)
+{
+	aPos = stage_input.aPos;
+	vert_main();
+	SPIRV_Cross_Output stage_output;
+	stage_output.gl_Position = gl_Position;
+	return stage_output;
+}
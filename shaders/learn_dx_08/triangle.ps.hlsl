@@ -0,0 +1,30 @@
+static float4 FragColor;
+static float4 vColor;
+
+struct SPIRV_Cross_Input
+{
+	float4 vColor : COLOR;
+};
+
+struct SPIRV_Cross_Output
+{
+	float4 FragColor : SV_Target0;
+};
+
+void frag_main()
+{
+#if GRAYSCALE
+	FragColor = float4(dot(vColor.rgb, float3(0.299f, 0.587f, 0.114f)).xxx, vColor.a);
+#else
+	FragColor = vColor;
+#endif
+}
+
+SPIRV_Cross_Output main(SPIRV_Cross_Input stage_input)
+{
+	vColor = stage_input.vColor;
+	frag_main();
+	SPIRV_Cross_Output stage_output;
+	stage_output.FragColor = FragColor;
+	return stage_output;
+}
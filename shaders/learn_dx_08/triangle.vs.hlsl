@@ -0,0 +1,41 @@
+static float4 gl_Position;
+static float4 vColor;
+static float3 aColor;
+static float2 aPos;
+
+struct SPIRV_Cross_Input
+{
+	float2 aPos : POSITION;
+#if VERTEX_COLOR
+	float3 aColor : COLOR;
+#endif
+};
+
+struct SPIRV_Cross_Output
+{
+	float4 vColor : COLOR;
+	float4 gl_Position : SV_Position;
+};
+
+void vert_main()
+{
+#if VERTEX_COLOR
+	vColor = float4(aColor, 1.0f);
+#else
+	vColor = float4(1.0f, 1.0f, 1.0f, 1.0f);
+#endif
+	gl_Position = float4(aPos, 0.0f, 1.0f);
+}
+
+SPIRV_Cross_Output main(SPIRV_Cross_Input stage_input)
+{
+#if VERTEX_COLOR
+	aColor = stage_input.aColor;
+#endif
+	aPos = stage_input.aPos;
+	vert_main();
+	SPIRV_Cross_Output stage_output;
+	stage_output.gl_Position = gl_Position;
+	stage_output.vColor = vColor;
+	return stage_output;
+}
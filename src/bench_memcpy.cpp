@@ -0,0 +1,76 @@
+// Compares d3dx12's row-by-row MemcpySubresource with MemcpySubresourceFast
+// when writing into write-combined memory, the way UPLOAD heaps are mapped.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include <Windows.h>
+
+#include "fast_memcpy.h"
+
+struct Case
+{
+	const char*	name;
+	UINT		width;			// Texels, 4 bytes each
+	UINT		height;
+	UINT		destRowPitch;
+};
+
+template<typename Copy>
+double measure(Copy&& copy, int iterations)
+{
+	std::vector<double> times;
+	for (int i = 0; i < iterations; i++)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		copy();
+		times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+int main()
+{
+	const int ITERATIONS = 20;
+
+	CopyWorkers workers;
+	workers.create();
+
+	const Case cases[] =
+	{
+		{ "4096x4096 packed", 4096, 4096, 4096 * 4 },
+		{ "4000x4000 pitched", 4000, 4000, (4000 * 4 + D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1) & ~(D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1) },
+		{ "256x256 packed", 256, 256, 256 * 4 },
+	};
+
+	for (const Case& c : cases)
+	{
+		const SIZE_T rowSize = c.width * 4U;
+		std::vector<BYTE> source(rowSize * c.height, 0x5a);
+
+		const SIZE_T destSize = SIZE_T(c.destRowPitch) * c.height;
+		auto dest = static_cast<BYTE*>(VirtualAlloc(nullptr, destSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE | PAGE_WRITECOMBINE));
+		if (!dest)
+		{
+			std::printf("VirtualAlloc failed\n");
+			return 1;
+		}
+
+		D3D12_SUBRESOURCE_DATA src{ source.data(), static_cast<LONG_PTR>(rowSize), static_cast<LONG_PTR>(source.size()) };
+		D3D12_MEMCPY_DEST dst{ dest, c.destRowPitch, destSize };
+
+		const double baseline = measure([&]() { MemcpySubresource(&dst, &src, rowSize, c.height, 1); }, ITERATIONS);
+		const double fast = measure([&]() { MemcpySubresourceFast(&dst, &src, rowSize, c.height, 1, &workers); }, ITERATIONS);
+
+		const double megabytes = static_cast<double>(source.size()) / (1024.0 * 1024.0);
+		std::printf("%-20s  memcpy %8.3f ms (%7.1f MB/s)   fast %8.3f ms (%7.1f MB/s)   x%.2f\n",
+			c.name, baseline, megabytes / (baseline / 1000.0), fast, megabytes / (fast / 1000.0), baseline / fast);
+
+		VirtualFree(dest, 0, MEM_RELEASE);
+	}
+
+	return 0;
+}
@@ -1,7 +1,29 @@
 #include "entry.h"
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+uint64_t pack_size(int width, int height)
+{
+	return (static_cast<uint64_t>(static_cast<uint32_t>(width)) << 32) | static_cast<uint32_t>(height);
+}
+
 void window_size_callback(GLFWwindow* window, int width, int height)
 {
+	gWindowSize = pack_size(width, height);
+}
+
+// Called on the render thread before each frame, so gWidth and gHeight never change during draw().
+void apply_window_size()
+{
+	const uint64_t size = gWindowSize.load();
+	const int width = static_cast<int>(size >> 32);
+	const int height = static_cast<int>(static_cast<uint32_t>(size));
+	if (width == gWidth && height == gHeight) return;
+
 	gWidth = width;
 	gHeight = height;
 	on_size();
@@ -17,8 +39,117 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 	on_mouse(xpos, ypos);
 }
 
-auto run() -> int
+void parse_args(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--frames-in-flight" && i + 1 < argc)
+		{
+			gFramesInFlight = std::stoi(argv[++i]);
+		}
+		else if (arg == "--serial")
+		{
+			gSerial = true;
+		}
+		else if (arg == "--headless")
+		{
+			gHeadless = true;
+			if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+			{
+				gHeadlessFrames = std::stoi(argv[++i]);
+			}
+		}
+		else if (arg == "--warp")
+		{
+			gWarp = true;
+		}
+		else if (arg == "--memory-budget" && i + 1 < argc)
+		{
+			gMemoryBudgetMB = std::stoi(argv[++i]);
+		}
+		else if (arg == "--draws" && i + 1 < argc)
+		{
+			gDrawCount = std::stoi(argv[++i]);
+		}
+	}
+}
+
+void simulation_loop()
+{
+	using clock = std::chrono::steady_clock;
+	const auto step = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(SIMULATION_STEP));
+
+	auto next = clock::now();
+	while (gRunning)
+	{
+		update();
+
+		// Fixed timestep, but never try to catch up on more than a few steps after a hitch.
+		next += step;
+		const auto now = clock::now();
+		if (now - next > 4 * step) next = now;
+		std::this_thread::sleep_until(next);
+	}
+}
+
+void render_loop()
+{
+	while (gRunning)
+	{
+		apply_window_size();
+		draw();
+	}
+}
+
+auto run_headless() -> int
 {
+	using clock = std::chrono::steady_clock;
+
+	gWidth = 800;
+	gHeight = 600;
+	init();
+
+	std::vector<double> frameTimes;
+	frameTimes.reserve(gHeadlessFrames);
+	for (int frame = 0; frame < gHeadlessFrames; frame++)
+	{
+		const auto begin = clock::now();
+		update();
+		draw();
+		const double frameTime = std::chrono::duration<double, std::milli>(clock::now() - begin).count();
+
+		frameTimes.push_back(frameTime);
+		std::cout << "frame " << frame << ": " << frameTime << " ms\n";
+	}
+
+	if (!frameTimes.empty())
+	{
+		std::vector<double> sorted = frameTimes;
+		std::sort(sorted.begin(), sorted.end());
+
+		double total = 0.0;
+		for (double frameTime : sorted) total += frameTime;
+
+		std::cout << "frames: " << sorted.size()
+			<< " avg: " << total / sorted.size() << " ms"
+			<< " min: " << sorted.front() << " ms"
+			<< " p50: " << sorted[sorted.size() / 2] << " ms"
+			<< " p99: " << sorted[(sorted.size() * 99) / 100] << " ms"
+			<< " max: " << sorted.back() << " ms" << std::endl;
+	}
+
+	if (gHeadlessReport) gHeadlessReport();
+
+	return EXIT_SUCCESS;
+}
+
+auto run(int argc, char** argv) -> int
+{
+	parse_args(argc, argv);
+
+	if (gHeadless) return run_headless();
+
 	if (glfwInit() == GLFW_FALSE) return EXIT_FAILURE;
 
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
@@ -26,18 +157,39 @@ auto run() -> int
 	if (g_pWindow == nullptr) return EXIT_FAILURE;
 
 	glfwGetWindowSize(g_pWindow, &gWidth, &gHeight);
+	gWindowSize = pack_size(gWidth, gHeight);
 
 	init();
 	auto prevWindowSizeCallback = glfwSetWindowSizeCallback(g_pWindow, window_size_callback);
 	auto prevKeyCallback = glfwSetKeyCallback(g_pWindow, key_callback);
 	auto prevMouseCallback = glfwSetCursorPosCallback(g_pWindow, mouse_callback);
 
-	while (glfwWindowShouldClose(g_pWindow) == GLFW_FALSE)
+	if (gSerial)
 	{
-		update();
-		draw();
+		while (glfwWindowShouldClose(g_pWindow) == GLFW_FALSE)
+		{
+			update();
+			apply_window_size();
+			draw();
+
+			glfwPollEvents();
+		}
+	}
+	else
+	{
+		// Input stays on the main thread, simulation of the next frame overlaps submission of this one.
+		gRunning = true;
+		std::thread simulationThread(simulation_loop);
+		std::thread renderThread(render_loop);
+
+		while (glfwWindowShouldClose(g_pWindow) == GLFW_FALSE)
+		{
+			glfwWaitEventsTimeout(SIMULATION_STEP);
+		}
 
-		glfwPollEvents();
+		gRunning = false;
+		renderThread.join();
+		simulationThread.join();
 	}
 
 	glfwSetKeyCallback(g_pWindow, prevKeyCallback);
@@ -22,8 +22,15 @@
 #include <DirectXColors.h>
 
 #include "d3dx12.h"
-
-const int MAX_FRAMES_IN_FLIGHT = 2;
+#include "frame_ring.h"
+#include "deferred_release.h"
+#include "heap_allocator.h"
+#include "snapshot_exchange.h"
+#include "constant_allocator.h"
+#include "root_signature_cache.h"
+#include "shader_cache.h"
+#include "pipeline_cache.h"
+#include "pipeline_builder.h"
 
 const char* vertexShaderSource = R"(
 static float4 gl_Position;
@@ -105,22 +112,26 @@ winrt::com_ptr<ID3D12CommandQueue>			g_commandQueue;
 winrt::com_ptr<ID3D12DescriptorHeap>		g_rtvDescriptorHeap;
 winrt::com_ptr<ID3D12DescriptorHeap>		g_dsvDescriptorHeap;
 
-winrt::com_ptr<ID3D12CommandAllocator>		g_commandAllocators[MAX_FRAMES_IN_FLIGHT];
 winrt::com_ptr<ID3D12GraphicsCommandList>   g_commandList;
 
 // Rendering resources
 winrt::com_ptr<IDXGISwapChain3>				g_swapChain;
 winrt::com_ptr<ID3D12Resource>				g_renderTargets[MAX_FRAMES_IN_FLIGHT];
 winrt::com_ptr<ID3D12Resource>				g_depthStencil;
+HeapAllocation								g_depthStencilAllocation;
 
-winrt::com_ptr<ID3D12Fence>					g_fence;
-UINT64                                      g_fenceValues[MAX_FRAMES_IN_FLIGHT];
-winrt::handle								g_fenceEvent;
+FrameRing									g_frameRing;
+DeferredReleaseQueue						g_deferredRelease;
+HeapManager									g_heapManager;
+RootSignatureCache							g_rootSignatures;
+ShaderCache									g_shaderCache;
+PipelineCache								g_pipelineCache;
+PipelineBuilder								g_pipelineBuilder;
 
 // Triangle
 winrt::com_ptr<ID3D12RootSignature>			g_rootSignature;
-winrt::com_ptr<ID3D12PipelineState>			g_pipeline;
-winrt::com_ptr<ID3D12Resource>				g_vertexBuffer;
+PendingPipeline								g_pipeline;
+BufferRange									g_vertexBuffer;
 D3D12_VERTEX_BUFFER_VIEW					g_vertexBufferView;
 
 // Other
@@ -129,9 +140,14 @@ UINT g_rtvDescriptorSize;
 UINT g_backBufferIndex = 0;
 
 // Constant
-UINT										g_alignedConstantBufferSize = ((2 * sizeof(float)) + 255) & ~255;
-winrt::com_ptr<ID3D12Resource>				g_constantBuffer;
-UINT8* g_mappedConstantBuffer;
+ConstantAllocator							g_constantAllocator;
+
+// Simulation, owned by the update() thread
+struct SimulationSnapshot
+{
+	float offsetX;
+};
+SnapshotExchange<SimulationSnapshot> g_simulation;
 
 float g_offsetX = 0.0f;
 
@@ -139,19 +155,7 @@ void onDeviceLost();
 
 void waitForGpu() noexcept
 {
-	if (g_commandQueue && g_fence && g_fenceEvent)
-	{
-		UINT64 fenceValue = g_fenceValues[g_backBufferIndex];
-		if (SUCCEEDED(g_commandQueue->Signal(g_fence.get(), fenceValue)))
-		{
-			if (SUCCEEDED(g_fence->SetEventOnCompletion(fenceValue, g_fenceEvent.get())))
-			{
-				WaitForSingleObjectEx(g_fenceEvent.get(), INFINITE, FALSE);
-
-				g_fenceValues[g_backBufferIndex]++;
-			}
-		}
-	}
+	g_frameRing.waitForGpu();
 }
 
 void createDevice()
@@ -179,13 +183,22 @@ void createDevice()
 	winrt::check_hresult(CreateDXGIFactory2(dxgiFactoryFlags, IID_IDXGIFactory4, g_factory.put_void()));
 
 	winrt::com_ptr<IDXGIAdapter1> adapter;
-	for (UINT adapterIndex = 0; DXGI_ERROR_NOT_FOUND != g_factory->EnumAdapters1(adapterIndex, adapter.put()); adapterIndex++)
+	if (gWarp)
 	{
-		DXGI_ADAPTER_DESC1 adapterDesc;
-		winrt::check_hresult(adapter->GetDesc1(&adapterDesc));
+		// Software rasterizer, lets the samples run on machines without a GPU.
+		winrt::check_hresult(g_factory->EnumWarpAdapter(IID_IDXGIAdapter1, adapter.put_void()));
+		winrt::check_hresult(D3D12CreateDevice(adapter.get(), D3D_FEATURE_LEVEL_11_0, IID_ID3D12Device, g_device.put_void()));
+	}
+	else
+	{
+		for (UINT adapterIndex = 0; DXGI_ERROR_NOT_FOUND != g_factory->EnumAdapters1(adapterIndex, adapter.put()); adapterIndex++)
+		{
+			DXGI_ADAPTER_DESC1 adapterDesc;
+			winrt::check_hresult(adapter->GetDesc1(&adapterDesc));
 
-		if (adapterDesc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) continue;
-		if (SUCCEEDED(D3D12CreateDevice(adapter.get(), D3D_FEATURE_LEVEL_11_0, IID_ID3D12Device, g_device.put_void()))) break;
+			if (adapterDesc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) continue;
+			if (SUCCEEDED(D3D12CreateDevice(adapter.get(), D3D_FEATURE_LEVEL_11_0, IID_ID3D12Device, g_device.put_void()))) break;
+		}
 	}
 
 	/*
@@ -212,9 +225,8 @@ void createDevice()
 		D3D12_ROOT_SIGNATURE_FLAG_DENY_PIXEL_SHADER_ROOT_ACCESS
 	);
 
-	winrt::com_ptr<ID3DBlob> signature;
-	winrt::check_hresult(D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, signature.put(), nullptr));
-	winrt::check_hresult(g_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_ID3D12RootSignature, g_rootSignature.put_void()));
+	g_rootSignatures.create(g_device.get());
+	g_rootSignature.copy_from(g_rootSignatures.get(rootSignatureDesc));
 
 	// Graphics pipeline
 	//std::vector<char> vertexShader;
@@ -227,11 +239,11 @@ void createDevice()
 	UINT compileFlags = 0;
 #endif
 
-	winrt::com_ptr<ID3DBlob> vertexShader;
-	winrt::com_ptr<ID3DBlob> pixelShader;
-	winrt::com_ptr<ID3DBlob> shaderError;
-	winrt::check_hresult(D3DCompile(vertexShaderSource, std::strlen(vertexShaderSource), nullptr, nullptr, nullptr, "main", "vs_5_0", compileFlags, 0, vertexShader.put(), nullptr));
-	winrt::check_hresult(D3DCompile(fragmentShaderSource, std::strlen(fragmentShaderSource), nullptr, nullptr, nullptr, "main", "ps_5_0", compileFlags, 0, pixelShader.put(), nullptr));
+	g_shaderCache.create();
+	g_pipelineCache.create(g_device.get(), g_factory.get(), "cache/learn_dx_03.pipelines");
+	g_pipelineBuilder.create(g_device.get(), &g_pipelineCache);
+	std::shared_future<D3D12_SHADER_BYTECODE> vertexShader = g_shaderCache.request(vertexShaderSource, "main", "vs_5_0", compileFlags);
+	std::shared_future<D3D12_SHADER_BYTECODE> pixelShader = g_shaderCache.request(fragmentShaderSource, "main", "ps_5_0", compileFlags);
 
 	/*
 	{
@@ -270,8 +282,6 @@ void createDevice()
 	psoDesc.pRootSignature = g_rootSignature.get();
 	//psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader.data(), vertexShader.size());
 	//psoDesc.PS = CD3DX12_SHADER_BYTECODE(pixelShader.data(), pixelShader.size());
-	psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader.get());
-	psoDesc.PS = CD3DX12_SHADER_BYTECODE(pixelShader.get());
 	psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
 	psoDesc.DepthStencilState.DepthEnable = FALSE;
@@ -281,7 +291,7 @@ void createDevice()
 	psoDesc.NumRenderTargets = 1;
 	psoDesc.RTVFormats[0] = DXGI_FORMAT_B8G8R8A8_UNORM;
 	psoDesc.SampleDesc.Count = 1;
-	winrt::check_hresult(g_device->CreateGraphicsPipelineState(&psoDesc, IID_ID3D12PipelineState, g_pipeline.put_void()));
+	g_pipeline = g_pipelineBuilder.build(psoDesc, vertexShader, pixelShader);
 
 	// Create the command queue.
 #if defined(_DEBUG)
@@ -321,14 +331,15 @@ void createDevice()
 
 	g_rtvDescriptorSize = g_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 
-	for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-	{
-		winrt::check_hresult(g_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_ID3D12CommandAllocator, g_commandAllocators[i].put_void()));
-	}
+	// Frame ring (command allocators and fence timeline)
+	g_frameRing.create(g_device.get(), g_commandQueue.get(), static_cast<UINT>(gFramesInFlight));
 
-	winrt::check_hresult(g_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, g_commandAllocators[0].get(), nullptr, IID_ID3D12CommandList, g_commandList.put_void()));
+	winrt::check_hresult(g_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, g_frameRing.frame(0).commandAllocator.get(), nullptr, IID_ID3D12CommandList, g_commandList.put_void()));
 	winrt::check_hresult(g_commandList->Close());
 
+	// Buffers and textures are placed in shared heap blocks.
+	g_heapManager.create(g_device.get());
+
 	// Triangle
 	float triangleVertices[] =
 	{
@@ -339,69 +350,37 @@ void createDevice()
 
 	const UINT vertexBufferSize = 3 * 6 * sizeof(float);
 
-	winrt::check_hresult(g_device->CreateCommittedResource
-	(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize),
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr,
-		IID_ID3D12Resource,
-		g_vertexBuffer.put_void()
-	));
+	// Packed into a shared upload heap block instead of a 64KB committed resource.
+	g_vertexBuffer = g_heapManager.allocateUpload(vertexBufferSize);
 
 	// Copy the triangle data to the vertex buffer.
-	UINT8* pVertexDataBegin;
-	CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
-	winrt::check_hresult(g_vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-	memcpy(pVertexDataBegin, triangleVertices, sizeof(triangleVertices));
-	g_vertexBuffer->Unmap(0, nullptr);
+	memcpy(g_vertexBuffer.cpuAddress, triangleVertices, sizeof(triangleVertices));
 
-	g_vertexBufferView.BufferLocation = g_vertexBuffer->GetGPUVirtualAddress();
+	g_vertexBufferView.BufferLocation = g_vertexBuffer.gpuAddress;
 	g_vertexBufferView.StrideInBytes = 6 * sizeof(float);
 	g_vertexBufferView.SizeInBytes = vertexBufferSize;
 
 	// Constant
-	{
-		const UINT64 constantBufferSize = g_alignedConstantBufferSize * MAX_FRAMES_IN_FLIGHT;
-
-		winrt::check_hresult(g_device->CreateCommittedResource
-		(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(constantBufferSize),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_ID3D12Resource,
-			g_constantBuffer.put_void()
-		));
-
-		// Map and initialize the constant buffer. We don't unmap this until the
-		// app closes. Keeping things mapped for the lifetime of the resource is okay.
-		CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
-		winrt::check_hresult(g_constantBuffer->Map(0, &readRange, reinterpret_cast<void**>(&g_mappedConstantBuffer)));
-	}
-
-	// Fence
-	winrt::check_hresult(g_device->CreateFence(g_fenceValues[g_backBufferIndex], D3D12_FENCE_FLAG_NONE, IID_ID3D12Fence, g_fence.put_void()));
-	g_fenceValues[g_backBufferIndex]++;
-
-	g_fenceEvent.attach(CreateEventEx(nullptr, nullptr, 0, EVENT_MODIFY_STATE | SYNCHRONIZE));
-	if (!g_fenceEvent)
-	{
-		throw std::system_error(std::error_code(static_cast<int>(GetLastError()), std::system_category()), "CreateEventEx");
-	}
+	// One persistently mapped buffer, split into a bump-allocated region per frame ring slot.
+	g_constantAllocator.create(g_device.get(), g_frameRing.frameCount());
 }
 
 void createResources()
 {
-	// Wait until all previous GPU work is complete.
-	waitForGpu();
+	// Back buffers can only be resized once the GPU is done with them,
+	// everything else goes through the deferred release queue.
+	if (g_swapChain)
+	{
+		waitForGpu();
+	}
 
 	for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
+		if (gHeadless)
+		{
+			g_deferredRelease.retire(g_renderTargets[i], g_frameRing.pendingValue());
+		}
 		g_renderTargets[i] = nullptr;
-		g_fenceValues[i] = g_fenceValues[g_backBufferIndex];
 	}
 
 	const DXGI_FORMAT backBufferFormat = DXGI_FORMAT_B8G8R8A8_UNORM;
@@ -409,9 +388,29 @@ void createResources()
 	const UINT backBufferWidth = static_cast<UINT>(gWidth);
 	const UINT backBufferHeight = static_cast<UINT>(gHeight);
 
-	if (g_swapChain)
+	if (gHeadless)
 	{
-		HRESULT hr = g_swapChain->ResizeBuffers(MAX_FRAMES_IN_FLIGHT, backBufferWidth, backBufferHeight, backBufferFormat, 0);
+		// Offscreen targets stand in for the swap chain. They start in PRESENT (COMMON)
+		// so the barriers in draw() stay the same.
+		D3D12_RESOURCE_DESC renderTargetDesc = CD3DX12_RESOURCE_DESC::Tex2D(backBufferFormat, backBufferWidth, backBufferHeight, 1, 1);
+		renderTargetDesc.Flags |= D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+
+		for (UINT i = 0; i < g_frameRing.frameCount(); i++)
+		{
+			winrt::check_hresult(g_device->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+				D3D12_HEAP_FLAG_NONE,
+				&renderTargetDesc,
+				D3D12_RESOURCE_STATE_PRESENT,
+				&CD3DX12_CLEAR_VALUE(backBufferFormat, DirectX::Colors::CornflowerBlue),
+				IID_ID3D12Resource,
+				g_renderTargets[i].put_void()
+			));
+		}
+	}
+	else if (g_swapChain)
+	{
+		HRESULT hr = g_swapChain->ResizeBuffers(g_frameRing.frameCount(), backBufferWidth, backBufferHeight, backBufferFormat, 0);
 		if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
 		{
 			onDeviceLost();
@@ -429,7 +428,7 @@ void createResources()
 		swapChainDesc.Height = backBufferHeight;
 		swapChainDesc.Format = backBufferFormat;
 		swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-		swapChainDesc.BufferCount = MAX_FRAMES_IN_FLIGHT;
+		swapChainDesc.BufferCount = g_frameRing.frameCount();
 		swapChainDesc.SampleDesc.Count = 1;
 		swapChainDesc.SampleDesc.Quality = 0;
 		swapChainDesc.Scaling = DXGI_SCALING_STRETCH;
@@ -452,9 +451,12 @@ void createResources()
 		winrt::check_hresult(g_factory->MakeWindowAssociation(g_window, DXGI_MWA_NO_ALT_ENTER));
 	}
 
-	for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	for (UINT i = 0; i < g_frameRing.frameCount(); i++)
 	{
-		winrt::check_hresult(g_swapChain->GetBuffer(i, IID_ID3D12Resource, g_renderTargets[i].put_void()));
+		if (!gHeadless)
+		{
+			winrt::check_hresult(g_swapChain->GetBuffer(i, IID_ID3D12Resource, g_renderTargets[i].put_void()));
+		}
 
 		CD3DX12_CPU_DESCRIPTOR_HANDLE rtvDescriptor
 		(
@@ -465,9 +467,9 @@ void createResources()
 		g_device->CreateRenderTargetView(g_renderTargets[i].get(), nullptr, rtvDescriptor);
 	}
 
-	g_backBufferIndex = g_swapChain->GetCurrentBackBufferIndex();
+	g_backBufferIndex = gHeadless ? 0 : g_swapChain->GetCurrentBackBufferIndex();
+	g_frameRing.beginFrame(g_backBufferIndex);
 
-	CD3DX12_HEAP_PROPERTIES depthHeapProperties(D3D12_HEAP_TYPE_DEFAULT);
 	D3D12_RESOURCE_DESC depthStencilDesc = CD3DX12_RESOURCE_DESC::Tex2D(
 		depthBufferFormat,
 		backBufferWidth,
@@ -482,15 +484,12 @@ void createResources()
 	depthOptimizedClearValue.DepthStencil.Depth = 1.0f;
 	depthOptimizedClearValue.DepthStencil.Stencil = 0;
 
-	winrt::check_hresult(g_device->CreateCommittedResource(
-		&depthHeapProperties,
-		D3D12_HEAP_FLAG_NONE,
-		&depthStencilDesc,
-		D3D12_RESOURCE_STATE_DEPTH_WRITE,
-		&depthOptimizedClearValue,
-		IID_ID3D12Resource,
-		g_depthStencil.put_void()
-	));
+	g_deferredRelease.retire(g_depthStencil, g_frameRing.pendingValue());
+	g_heapManager.free(g_depthStencilAllocation, g_frameRing.pendingValue());
+
+	PlacedResource depthStencil = g_heapManager.createResource(depthStencilDesc, D3D12_RESOURCE_STATE_DEPTH_WRITE, &depthOptimizedClearValue);
+	g_depthStencil = depthStencil.resource;
+	g_depthStencilAllocation = depthStencil.allocation;
 
 	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
 	dsvDesc.Format = depthBufferFormat;
@@ -501,8 +500,10 @@ void createResources()
 
 void clear()
 {
-	winrt::check_hresult(g_commandAllocators[g_backBufferIndex]->Reset());
-	winrt::check_hresult(g_commandList->Reset(g_commandAllocators[g_backBufferIndex].get(), nullptr));
+	FrameContext& frame = g_frameRing.current();
+	winrt::check_hresult(frame.commandAllocator->Reset());
+	winrt::check_hresult(g_commandList->Reset(frame.commandAllocator.get(), nullptr));
+	g_constantAllocator.beginFrame(g_frameRing.frameIndex());
 
 	D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(g_renderTargets[g_backBufferIndex].get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
 	g_commandList->ResourceBarrier(1, &barrier);
@@ -528,22 +529,25 @@ void clear()
 
 void moveToNextFrame()
 {
-	// Schedule a Signal command in the queue.
-	const UINT64 currentFenceValue = g_fenceValues[g_backBufferIndex];
-	winrt::check_hresult(g_commandQueue->Signal(g_fence.get(), currentFenceValue));
+	// Schedule a Signal command in the queue and stamp the current slot with it.
+	g_frameRing.endFrame();
 
 	// Update the back buffer index.
-	g_backBufferIndex = g_swapChain->GetCurrentBackBufferIndex();
-
-	// If the next frame is not ready to be rendered yet, wait until it is ready.
-	if (g_fence->GetCompletedValue() < g_fenceValues[g_backBufferIndex])
+	if (gHeadless)
 	{
-		winrt::check_hresult(g_fence->SetEventOnCompletion(g_fenceValues[g_backBufferIndex], g_fenceEvent.get()));
-		WaitForSingleObjectEx(g_fenceEvent.get(), INFINITE, FALSE);
+		g_backBufferIndex = (g_backBufferIndex + 1) % g_frameRing.frameCount();
 	}
+	else
+	{
+		g_backBufferIndex = g_swapChain->GetCurrentBackBufferIndex();
+	}
+
+	// If the next frame is not ready to be rendered yet, wait until it is ready.
+	g_frameRing.beginFrame(g_backBufferIndex);
 
-	// Set the fence value for the next frame.
-	g_fenceValues[g_backBufferIndex] = currentFenceValue + 1;
+	// Release whatever the GPU has finished with.
+	g_deferredRelease.collect(g_frameRing.completedValue());
+	g_heapManager.collect(g_frameRing.completedValue());
 }
 
 void present()
@@ -559,8 +563,8 @@ void present()
 
 	// The first argument instructs DXGI to block until VSync, putting the application
 	// to sleep until the next VSync. This ensures we don't waste any cycles rendering
-	// frames that will never be displayed to the screen.
-	HRESULT hr = g_swapChain->Present(1, 0);
+	// frames that will never be displayed to the screen. Headless runs skip presentation.
+	HRESULT hr = gHeadless ? S_OK : g_swapChain->Present(1, 0);
 
 	// If the device was reset we must completely reinitialize the renderer.
 	if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
@@ -577,7 +581,7 @@ void present()
 
 bool init()
 {
-	g_window = glfwGetWin32Window(g_pWindow);
+	g_window = g_pWindow ? glfwGetWin32Window(g_pWindow) : nullptr;
 	createDevice();
 	createResources();
 
@@ -605,18 +609,25 @@ void update()
 {
 	g_offsetX += 0.001f;
 	if (g_offsetX > 0.5f) g_offsetX = -0.5f;
-	UINT8* destination = g_mappedConstantBuffer + (g_backBufferIndex * g_alignedConstantBufferSize);
-	float offset[] = { g_offsetX, 0.2f };
-	memcpy(destination, offset, 2 * sizeof(float));
+
+	g_simulation.back().offsetX = g_offsetX;
+	g_simulation.publish();
 }
 
 void draw()
 {
+	g_simulation.acquire();
+	const SimulationSnapshot& snapshot = g_simulation.front();
+
 	clear();
 
+	// Constants live in this frame's region of the allocator, one slice per draw.
+	float offset[] = { snapshot.offsetX, 0.2f };
+	D3D12_GPU_VIRTUAL_ADDRESS offsetAddress = g_constantAllocator.push(offset);
+
 	g_commandList->SetPipelineState(g_pipeline.get());
 	g_commandList->SetGraphicsRootSignature(g_rootSignature.get());
-	g_commandList->SetGraphicsRootConstantBufferView(0, g_constantBuffer->GetGPUVirtualAddress() + g_alignedConstantBufferSize * g_backBufferIndex);
+	g_commandList->SetGraphicsRootConstantBufferView(0, offsetAddress);
 	g_commandList->IASetVertexBuffers(0, 1, &g_vertexBufferView);
 	g_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	g_commandList->DrawInstanced(3, 1, 0, 0);
@@ -624,21 +635,29 @@ void draw()
 	present();
 }
 
-int main()
+int main(int argc, char** argv)
 {
-	return run();
+	return run(argc, argv);
 }
 
 void onDeviceLost()
 {
+	// The device is gone, nothing retired on it needs to wait.
+	g_deferredRelease.flush();
+	g_rootSignatures.destroy();
+	g_pipelineBuilder.destroy();
+	g_pipelineCache.destroy();
+	g_constantAllocator.destroy();
+	g_heapManager.destroy();
+	g_frameRing.destroy();
 	for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		g_commandAllocators[i] = nullptr;
 		g_renderTargets[i] = nullptr;
 	}
 
 	g_depthStencil = nullptr;
-	g_fence = nullptr;
+	g_depthStencilAllocation = {};
+	g_vertexBuffer = {};
 	g_commandList = nullptr;
 	g_swapChain = nullptr;
 	g_rtvDescriptorHeap = nullptr;
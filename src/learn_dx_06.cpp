@@ -1,5 +1,6 @@
 #include "entry.h"
 
+#include <algorithm>
 #include <fstream>
 
 #define GLFW_EXPOSE_NATIVE_WIN32
@@ -22,8 +23,15 @@
 #include <DirectXColors.h>
 
 #include "d3dx12.h"
-
-const int MAX_FRAMES_IN_FLIGHT = 2;
+#include "frame_ring.h"
+#include "deferred_release.h"
+#include "heap_allocator.h"
+#include "transient_resources.h"
+#include "descriptor_allocator.h"
+#include "root_signature_cache.h"
+#include "shader_cache.h"
+#include "pipeline_cache.h"
+#include "pipeline_builder.h"
 
 const char* vertexShaderSource = R"(
 static float4 gl_Position;
@@ -164,22 +172,26 @@ winrt::com_ptr<ID3D12CommandQueue>			g_commandQueue;
 winrt::com_ptr<ID3D12DescriptorHeap>		g_rtvDescriptorHeap;
 winrt::com_ptr<ID3D12DescriptorHeap>		g_dsvDescriptorHeap;
 
-winrt::com_ptr<ID3D12CommandAllocator>		g_commandAllocators[MAX_FRAMES_IN_FLIGHT];
 winrt::com_ptr<ID3D12GraphicsCommandList>   g_commandList;
 
 // Rendering resources
 winrt::com_ptr<IDXGISwapChain3>				g_swapChain;
 winrt::com_ptr<ID3D12Resource>				g_renderTargets[MAX_FRAMES_IN_FLIGHT];
 winrt::com_ptr<ID3D12Resource>				g_depthStencil;
+HeapAllocation								g_depthStencilAllocation;
 
-winrt::com_ptr<ID3D12Fence>					g_fence;
-UINT64                                      g_fenceValues[MAX_FRAMES_IN_FLIGHT];
-winrt::handle								g_fenceEvent;
+FrameRing									g_frameRing;
+DeferredReleaseQueue						g_deferredRelease;
+HeapManager									g_heapManager;
+RootSignatureCache							g_rootSignatures;
+ShaderCache									g_shaderCache;
+PipelineCache								g_pipelineCache;
+PipelineBuilder								g_pipelineBuilder;
 
 // Triangle
 winrt::com_ptr<ID3D12RootSignature>			g_rootSignature;
-winrt::com_ptr<ID3D12PipelineState>			g_pipeline;
-winrt::com_ptr<ID3D12Resource>				g_vertexBuffer;
+PendingPipeline								g_pipeline;
+BufferRange									g_vertexBuffer;
 D3D12_VERTEX_BUFFER_VIEW					g_vertexBufferView;
 
 // Other
@@ -189,29 +201,24 @@ UINT g_backBufferIndex = 0;
 
 // Render
 winrt::com_ptr<ID3D12RootSignature>			g_renderRootSignature;
-winrt::com_ptr<ID3D12PipelineState>			g_renderPipeline;
-
-winrt::com_ptr<ID3D12Resource>				g_renderTexture;
-winrt::com_ptr<ID3D12DescriptorHeap>		g_renderDescriptorHeap;
-winrt::com_ptr<ID3D12DescriptorHeap>		g_srvDescriptorHeap;
+PendingPipeline								g_renderPipeline;
+
+TransientResourcePool						g_transients;
+UINT										g_renderTexture;
+UINT										g_insetTexture;
+StagingDescriptorHeap						g_stagingRtvs;
+StagingDescriptorHeap						g_stagingDescriptors;
+ShaderVisibleDescriptorHeap					g_shaderDescriptors;
+DescriptorHandle							g_renderTextureRtv;
+DescriptorHandle							g_renderTextureSrv;
+DescriptorHandle							g_insetTextureRtv;
+DescriptorHandle							g_insetTextureSrv;
 
 void onDeviceLost();
 
 void waitForGpu() noexcept
 {
-	if (g_commandQueue && g_fence && g_fenceEvent)
-	{
-		UINT64 fenceValue = g_fenceValues[g_backBufferIndex];
-		if (SUCCEEDED(g_commandQueue->Signal(g_fence.get(), fenceValue)))
-		{
-			if (SUCCEEDED(g_fence->SetEventOnCompletion(fenceValue, g_fenceEvent.get())))
-			{
-				WaitForSingleObjectEx(g_fenceEvent.get(), INFINITE, FALSE);
-
-				g_fenceValues[g_backBufferIndex]++;
-			}
-		}
-	}
+	g_frameRing.waitForGpu();
 }
 
 void createDevice()
@@ -239,13 +246,22 @@ void createDevice()
 	winrt::check_hresult(CreateDXGIFactory2(dxgiFactoryFlags, IID_IDXGIFactory4, g_factory.put_void()));
 
 	winrt::com_ptr<IDXGIAdapter1> adapter;
-	for (UINT adapterIndex = 0; DXGI_ERROR_NOT_FOUND != g_factory->EnumAdapters1(adapterIndex, adapter.put()); adapterIndex++)
+	if (gWarp)
+	{
+		// Software rasterizer, lets the samples run on machines without a GPU.
+		winrt::check_hresult(g_factory->EnumWarpAdapter(IID_IDXGIAdapter1, adapter.put_void()));
+		winrt::check_hresult(D3D12CreateDevice(adapter.get(), D3D_FEATURE_LEVEL_11_0, IID_ID3D12Device, g_device.put_void()));
+	}
+	else
 	{
-		DXGI_ADAPTER_DESC1 adapterDesc;
-		winrt::check_hresult(adapter->GetDesc1(&adapterDesc));
+		for (UINT adapterIndex = 0; DXGI_ERROR_NOT_FOUND != g_factory->EnumAdapters1(adapterIndex, adapter.put()); adapterIndex++)
+		{
+			DXGI_ADAPTER_DESC1 adapterDesc;
+			winrt::check_hresult(adapter->GetDesc1(&adapterDesc));
 
-		if (adapterDesc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) continue;
-		if (SUCCEEDED(D3D12CreateDevice(adapter.get(), D3D_FEATURE_LEVEL_11_0, IID_ID3D12Device, g_device.put_void()))) break;
+			if (adapterDesc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) continue;
+			if (SUCCEEDED(D3D12CreateDevice(adapter.get(), D3D_FEATURE_LEVEL_11_0, IID_ID3D12Device, g_device.put_void()))) break;
+		}
 	}
 
 	/*
@@ -261,9 +277,8 @@ void createDevice()
 	CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc;
 	rootSignatureDesc.Init(0, nullptr, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
-	winrt::com_ptr<ID3DBlob> signature;
-	winrt::check_hresult(D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, signature.put(), nullptr));
-	winrt::check_hresult(g_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_ID3D12RootSignature, g_rootSignature.put_void()));
+	g_rootSignatures.create(g_device.get());
+	g_rootSignature.copy_from(g_rootSignatures.get(rootSignatureDesc));
 
 	// Render Root signature
 	{
@@ -291,9 +306,7 @@ void createDevice()
 		CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc;
 		rootSignatureDesc.Init(1, &rootParameter, 1, &sampler, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
-		winrt::com_ptr<ID3DBlob> signature;
-		winrt::check_hresult(D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, signature.put(), nullptr));
-		winrt::check_hresult(g_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_ID3D12RootSignature, g_renderRootSignature.put_void()));
+		g_renderRootSignature.copy_from(g_rootSignatures.get(rootSignatureDesc));
 	}
 
 	// Graphics pipeline
@@ -307,11 +320,13 @@ void createDevice()
 	UINT compileFlags = 0;
 #endif
 
-	winrt::com_ptr<ID3DBlob> vertexShader;
-	winrt::com_ptr<ID3DBlob> pixelShader;
-	//winrt::com_ptr<ID3DBlob> shaderError;
-	winrt::check_hresult(D3DCompile(vertexShaderSource, std::strlen(vertexShaderSource), nullptr, nullptr, nullptr, "main", "vs_5_0", compileFlags, 0, vertexShader.put(), nullptr));
-	winrt::check_hresult(D3DCompile(fragmentShaderSource, std::strlen(fragmentShaderSource), nullptr, nullptr, nullptr, "main", "ps_5_0", compileFlags, 0, pixelShader.put(), nullptr));
+	g_shaderCache.create();
+	g_pipelineCache.create(g_device.get(), g_factory.get(), "cache/learn_dx_06.pipelines");
+	g_pipelineBuilder.create(g_device.get(), &g_pipelineCache);
+	std::shared_future<D3D12_SHADER_BYTECODE> vertexShader = g_shaderCache.request(vertexShaderSource, "main", "vs_5_0", compileFlags);
+	std::shared_future<D3D12_SHADER_BYTECODE> pixelShader = g_shaderCache.request(fragmentShaderSource, "main", "ps_5_0", compileFlags);
+	std::shared_future<D3D12_SHADER_BYTECODE> renderVertexShader = g_shaderCache.request(renderVertexShaderSource, "main", "vs_5_0", compileFlags);
+	std::shared_future<D3D12_SHADER_BYTECODE> renderPixelShader = g_shaderCache.request(renderFragmentShaderSource, "main", "ps_5_0", compileFlags);
 
 	/*
 	{
@@ -352,8 +367,6 @@ void createDevice()
 	psoDesc.pRootSignature = g_rootSignature.get();
 	//psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader.data(), vertexShader.size());
 	//psoDesc.PS = CD3DX12_SHADER_BYTECODE(pixelShader.data(), pixelShader.size());
-	psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader.get());
-	psoDesc.PS = CD3DX12_SHADER_BYTECODE(pixelShader.get());
 	psoDesc.RasterizerState = rasterizerDesc;
 	psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
 	psoDesc.DepthStencilState.DepthEnable = FALSE;
@@ -363,15 +376,10 @@ void createDevice()
 	psoDesc.NumRenderTargets = 1;
 	psoDesc.RTVFormats[0] = DXGI_FORMAT_B8G8R8A8_UNORM;
 	psoDesc.SampleDesc.Count = 1;
-	winrt::check_hresult(g_device->CreateGraphicsPipelineState(&psoDesc, IID_ID3D12PipelineState, g_pipeline.put_void()));
+	g_pipeline = g_pipelineBuilder.build(psoDesc, vertexShader, pixelShader);
 
 	// Render pipeline
 	{
-		winrt::com_ptr<ID3DBlob> renderVertexShader;
-		winrt::com_ptr<ID3DBlob> renderPixelShader;
-		winrt::check_hresult(D3DCompile(renderVertexShaderSource, std::strlen(renderVertexShaderSource), nullptr, nullptr, nullptr, "main", "vs_5_0", compileFlags, 0, renderVertexShader.put(), nullptr));
-		winrt::check_hresult(D3DCompile(renderFragmentShaderSource, std::strlen(renderFragmentShaderSource), nullptr, nullptr, nullptr, "main", "ps_5_0", compileFlags, 0, renderPixelShader.put(), nullptr));
-
 		D3D12_RASTERIZER_DESC rasterizerDesc = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 		rasterizerDesc.CullMode = D3D12_CULL_MODE_NONE;
 		D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{};
@@ -379,8 +387,6 @@ void createDevice()
 		psoDesc.pRootSignature = g_renderRootSignature.get();
 		//psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader.data(), vertexShader.size());
 		//psoDesc.PS = CD3DX12_SHADER_BYTECODE(pixelShader.data(), pixelShader.size());
-		psoDesc.VS = CD3DX12_SHADER_BYTECODE(renderVertexShader.get());
-		psoDesc.PS = CD3DX12_SHADER_BYTECODE(renderPixelShader.get());
 		psoDesc.RasterizerState = rasterizerDesc;
 		psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
 		psoDesc.DepthStencilState.DepthEnable = FALSE;
@@ -390,7 +396,7 @@ void createDevice()
 		psoDesc.NumRenderTargets = 1;
 		psoDesc.RTVFormats[0] = DXGI_FORMAT_B8G8R8A8_UNORM;
 		psoDesc.SampleDesc.Count = 1;
-		winrt::check_hresult(g_device->CreateGraphicsPipelineState(&psoDesc, IID_ID3D12PipelineState, g_renderPipeline.put_void()));
+		g_renderPipeline = g_pipelineBuilder.build(psoDesc, renderVertexShader, renderPixelShader);
 	}
 
 	// Create the command queue.
@@ -432,27 +438,26 @@ void createDevice()
 	winrt::check_hresult(g_device->CreateDescriptorHeap(&rtvDescriptorHeapDesc, IID_ID3D12DescriptorHeap, g_rtvDescriptorHeap.put_void()));
 	winrt::check_hresult(g_device->CreateDescriptorHeap(&dsvDescriptorHeapDesc, IID_ID3D12DescriptorHeap, g_dsvDescriptorHeap.put_void()));
 
-	D3D12_DESCRIPTOR_HEAP_DESC renderDescriptorHeapDesc = {};
-	renderDescriptorHeapDesc.NumDescriptors = 1;
-	renderDescriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
-	winrt::check_hresult(g_device->CreateDescriptorHeap(&renderDescriptorHeapDesc, IID_ID3D12DescriptorHeap, g_renderDescriptorHeap.put_void()));
-
-	D3D12_DESCRIPTOR_HEAP_DESC srvDescriptorHeapDesc = {};
-	srvDescriptorHeapDesc.NumDescriptors = 1;
-	srvDescriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	srvDescriptorHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	winrt::check_hresult(g_device->CreateDescriptorHeap(&srvDescriptorHeapDesc, IID_ID3D12DescriptorHeap, g_srvDescriptorHeap.put_void()));
-
 	g_rtvDescriptorSize = g_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 
-	for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-	{
-		winrt::check_hresult(g_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_ID3D12CommandAllocator, g_commandAllocators[i].put_void()));
-	}
+	// Frame ring (command allocators and fence timeline)
+	g_frameRing.create(g_device.get(), g_commandQueue.get(), static_cast<UINT>(gFramesInFlight));
 
-	winrt::check_hresult(g_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, g_commandAllocators[0].get(), nullptr, IID_ID3D12CommandList, g_commandList.put_void()));
+	// Render texture views are rewritten on resize and copied into the shader-visible heap per frame.
+	g_stagingRtvs.create(g_device.get(), D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+	g_stagingDescriptors.create(g_device.get(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	g_shaderDescriptors.create(g_device.get(), g_frameRing.frameCount());
+	g_renderTextureRtv = g_stagingRtvs.allocate();
+	g_renderTextureSrv = g_stagingDescriptors.allocate();
+	g_insetTextureRtv = g_stagingRtvs.allocate();
+	g_insetTextureSrv = g_stagingDescriptors.allocate();
+
+	winrt::check_hresult(g_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, g_frameRing.frame(0).commandAllocator.get(), nullptr, IID_ID3D12CommandList, g_commandList.put_void()));
 	winrt::check_hresult(g_commandList->Close());
 
+	// Buffers and textures are placed in shared heap blocks.
+	g_heapManager.create(g_device.get());
+
 	// Triangle
 	float triangleVertices[] =
 	{
@@ -463,77 +468,36 @@ void createDevice()
 
 	const UINT vertexBufferSize = 3 * 6 * sizeof(float);
 
-	winrt::check_hresult(g_device->CreateCommittedResource
-	(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize),
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr,
-		IID_ID3D12Resource,
-		g_vertexBuffer.put_void()
-	));
+	// Packed into a shared upload heap block instead of a 64KB committed resource.
+	g_vertexBuffer = g_heapManager.allocateUpload(vertexBufferSize);
 
 	// Copy the triangle data to the vertex buffer.
-	UINT8* pVertexDataBegin;
-	CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
-	winrt::check_hresult(g_vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-	memcpy(pVertexDataBegin, triangleVertices, sizeof(triangleVertices));
-	g_vertexBuffer->Unmap(0, nullptr);
+	memcpy(g_vertexBuffer.cpuAddress, triangleVertices, sizeof(triangleVertices));
 
-	g_vertexBufferView.BufferLocation = g_vertexBuffer->GetGPUVirtualAddress();
+	g_vertexBufferView.BufferLocation = g_vertexBuffer.gpuAddress;
 	g_vertexBufferView.StrideInBytes = 6 * sizeof(float);
 	g_vertexBufferView.SizeInBytes = vertexBufferSize;
 
 	// Render
-	CD3DX12_RESOURCE_DESC renderTextureDesc
-	(
-		D3D12_RESOURCE_DIMENSION_TEXTURE2D,
-		0,
-		static_cast<UINT>(gWidth),
-		static_cast<UINT>(gHeight),
-		1, 1,
-		DXGI_FORMAT_B8G8R8A8_UNORM,
-		1, 0, D3D12_TEXTURE_LAYOUT_UNKNOWN,
-		D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
-	);
-	float clearColor[] = { 0.0f, 0.2f, 0.3f, 1.0f };
-	winrt::check_hresult(g_device->CreateCommittedResource
-	(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
-		&renderTextureDesc,
-		D3D12_RESOURCE_STATE_RENDER_TARGET,
-		&CD3DX12_CLEAR_VALUE(renderTextureDesc.Format, clearColor),
-		IID_ID3D12Resource,
-		g_renderTexture.put_void()
-	));
-	CD3DX12_CPU_DESCRIPTOR_HANDLE renderCpuHandle(g_renderDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
-	g_device->CreateRenderTargetView(g_renderTexture.get(), nullptr, renderCpuHandle);
-
-	CD3DX12_CPU_DESCRIPTOR_HANDLE srvCpuHandle(g_srvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
-	g_device->CreateShaderResourceView(g_renderTexture.get(), nullptr, srvCpuHandle);
-
-	// Fence
-	winrt::check_hresult(g_device->CreateFence(g_fenceValues[g_backBufferIndex], D3D12_FENCE_FLAG_NONE, IID_ID3D12Fence, g_fence.put_void()));
-	g_fenceValues[g_backBufferIndex]++;
-
-	g_fenceEvent.attach(CreateEventEx(nullptr, nullptr, 0, EVENT_MODIFY_STATE | SYNCHRONIZE));
-	if (!g_fenceEvent)
-	{
-		throw std::system_error(std::error_code(static_cast<int>(GetLastError()), std::system_category()), "CreateEventEx");
-	}
+	g_transients.create(g_device.get());
 }
 
 void createResources()
 {
-	// Wait until all previous GPU work is complete.
-	waitForGpu();
+	// Back buffers can only be resized once the GPU is done with them,
+	// everything else goes through the deferred release queue.
+	if (g_swapChain)
+	{
+		waitForGpu();
+	}
 
 	for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
+		if (gHeadless)
+		{
+			g_deferredRelease.retire(g_renderTargets[i], g_frameRing.pendingValue());
+		}
 		g_renderTargets[i] = nullptr;
-		g_fenceValues[i] = g_fenceValues[g_backBufferIndex];
 	}
 
 	const DXGI_FORMAT backBufferFormat = DXGI_FORMAT_B8G8R8A8_UNORM;
@@ -541,9 +505,29 @@ void createResources()
 	const UINT backBufferWidth = static_cast<UINT>(gWidth);
 	const UINT backBufferHeight = static_cast<UINT>(gHeight);
 
-	if (g_swapChain)
+	if (gHeadless)
 	{
-		HRESULT hr = g_swapChain->ResizeBuffers(MAX_FRAMES_IN_FLIGHT, backBufferWidth, backBufferHeight, backBufferFormat, 0);
+		// Offscreen targets stand in for the swap chain. They start in PRESENT (COMMON)
+		// so the barriers in draw() stay the same.
+		D3D12_RESOURCE_DESC renderTargetDesc = CD3DX12_RESOURCE_DESC::Tex2D(backBufferFormat, backBufferWidth, backBufferHeight, 1, 1);
+		renderTargetDesc.Flags |= D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+
+		for (UINT i = 0; i < g_frameRing.frameCount(); i++)
+		{
+			winrt::check_hresult(g_device->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+				D3D12_HEAP_FLAG_NONE,
+				&renderTargetDesc,
+				D3D12_RESOURCE_STATE_PRESENT,
+				&CD3DX12_CLEAR_VALUE(backBufferFormat, DirectX::Colors::CornflowerBlue),
+				IID_ID3D12Resource,
+				g_renderTargets[i].put_void()
+			));
+		}
+	}
+	else if (g_swapChain)
+	{
+		HRESULT hr = g_swapChain->ResizeBuffers(g_frameRing.frameCount(), backBufferWidth, backBufferHeight, backBufferFormat, 0);
 		if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
 		{
 			onDeviceLost();
@@ -561,7 +545,7 @@ void createResources()
 		swapChainDesc.Height = backBufferHeight;
 		swapChainDesc.Format = backBufferFormat;
 		swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-		swapChainDesc.BufferCount = MAX_FRAMES_IN_FLIGHT;
+		swapChainDesc.BufferCount = g_frameRing.frameCount();
 		swapChainDesc.SampleDesc.Count = 1;
 		swapChainDesc.SampleDesc.Quality = 0;
 		swapChainDesc.Scaling = DXGI_SCALING_STRETCH;
@@ -584,9 +568,12 @@ void createResources()
 		winrt::check_hresult(g_factory->MakeWindowAssociation(g_window, DXGI_MWA_NO_ALT_ENTER));
 	}
 
-	for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	for (UINT i = 0; i < g_frameRing.frameCount(); i++)
 	{
-		winrt::check_hresult(g_swapChain->GetBuffer(i, IID_ID3D12Resource, g_renderTargets[i].put_void()));
+		if (!gHeadless)
+		{
+			winrt::check_hresult(g_swapChain->GetBuffer(i, IID_ID3D12Resource, g_renderTargets[i].put_void()));
+		}
 
 		CD3DX12_CPU_DESCRIPTOR_HANDLE rtvDescriptor
 		(
@@ -597,9 +584,9 @@ void createResources()
 		g_device->CreateRenderTargetView(g_renderTargets[i].get(), nullptr, rtvDescriptor);
 	}
 
-	g_backBufferIndex = g_swapChain->GetCurrentBackBufferIndex();
+	g_backBufferIndex = gHeadless ? 0 : g_swapChain->GetCurrentBackBufferIndex();
+	g_frameRing.beginFrame(g_backBufferIndex);
 
-	CD3DX12_HEAP_PROPERTIES depthHeapProperties(D3D12_HEAP_TYPE_DEFAULT);
 	D3D12_RESOURCE_DESC depthStencilDesc = CD3DX12_RESOURCE_DESC::Tex2D(
 		depthBufferFormat,
 		backBufferWidth,
@@ -614,54 +601,78 @@ void createResources()
 	depthOptimizedClearValue.DepthStencil.Depth = 1.0f;
 	depthOptimizedClearValue.DepthStencil.Stencil = 0;
 
-	winrt::check_hresult(g_device->CreateCommittedResource(
-		&depthHeapProperties,
-		D3D12_HEAP_FLAG_NONE,
-		&depthStencilDesc,
-		D3D12_RESOURCE_STATE_DEPTH_WRITE,
-		&depthOptimizedClearValue,
-		IID_ID3D12Resource,
-		g_depthStencil.put_void()
-	));
+	g_deferredRelease.retire(g_depthStencil, g_frameRing.pendingValue());
+	g_heapManager.free(g_depthStencilAllocation, g_frameRing.pendingValue());
+
+	PlacedResource depthStencil = g_heapManager.createResource(depthStencilDesc, D3D12_RESOURCE_STATE_DEPTH_WRITE, &depthOptimizedClearValue);
+	g_depthStencil = depthStencil.resource;
+	g_depthStencilAllocation = depthStencil.allocation;
 
 	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
 	dsvDesc.Format = depthBufferFormat;
 	dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
 
 	g_device->CreateDepthStencilView(g_depthStencil.get(), &dsvDesc, g_dsvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+
+	// Render texture, only alive from the offscreen pass (0) to the composite pass (1).
+	// The inset texture lives from pass 2 to 3 and is placed over the same memory.
+	g_transients.reset(g_deferredRelease, g_frameRing.pendingValue());
+
+	CD3DX12_RESOURCE_DESC renderTextureDesc
+	(
+		D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+		0,
+		backBufferWidth,
+		backBufferHeight,
+		1, 1,
+		DXGI_FORMAT_B8G8R8A8_UNORM,
+		1, 0, D3D12_TEXTURE_LAYOUT_UNKNOWN,
+		D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
+	);
+	float clearColor[] = { 0.0f, 0.2f, 0.3f, 1.0f };
+	g_renderTexture = g_transients.declare(renderTextureDesc, &CD3DX12_CLEAR_VALUE(renderTextureDesc.Format, clearColor), 0, 1);
+
+	CD3DX12_RESOURCE_DESC insetTextureDesc = renderTextureDesc;
+	insetTextureDesc.Width = (std::max)(backBufferWidth / 2, 1U);
+	insetTextureDesc.Height = (std::max)(backBufferHeight / 2, 1U);
+	float insetClearColor[] = { 0.3f, 0.2f, 0.0f, 1.0f };
+	g_insetTexture = g_transients.declare(insetTextureDesc, &CD3DX12_CLEAR_VALUE(insetTextureDesc.Format, insetClearColor), 2, 3);
+	g_transients.compile();
+
+	g_device->CreateRenderTargetView(g_transients.resource(g_renderTexture), nullptr, g_renderTextureRtv.cpu);
+	g_device->CreateShaderResourceView(g_transients.resource(g_renderTexture), nullptr, g_renderTextureSrv.cpu);
+	g_device->CreateRenderTargetView(g_transients.resource(g_insetTexture), nullptr, g_insetTextureRtv.cpu);
+	g_device->CreateShaderResourceView(g_transients.resource(g_insetTexture), nullptr, g_insetTextureSrv.cpu);
 }
 
 void moveToNextFrame()
 {
-	// Schedule a Signal command in the queue.
-	const UINT64 currentFenceValue = g_fenceValues[g_backBufferIndex];
-	winrt::check_hresult(g_commandQueue->Signal(g_fence.get(), currentFenceValue));
+	// Schedule a Signal command in the queue and stamp the current slot with it.
+	g_frameRing.endFrame();
 
 	// Update the back buffer index.
-	g_backBufferIndex = g_swapChain->GetCurrentBackBufferIndex();
-
-	// If the next frame is not ready to be rendered yet, wait until it is ready.
-	if (g_fence->GetCompletedValue() < g_fenceValues[g_backBufferIndex])
+	if (gHeadless)
 	{
-		winrt::check_hresult(g_fence->SetEventOnCompletion(g_fenceValues[g_backBufferIndex], g_fenceEvent.get()));
-		WaitForSingleObjectEx(g_fenceEvent.get(), INFINITE, FALSE);
+		g_backBufferIndex = (g_backBufferIndex + 1) % g_frameRing.frameCount();
+	}
+	else
+	{
+		g_backBufferIndex = g_swapChain->GetCurrentBackBufferIndex();
 	}
 
-	// Set the fence value for the next frame.
-	g_fenceValues[g_backBufferIndex] = currentFenceValue + 1;
+	// If the next frame is not ready to be rendered yet, wait until it is ready.
+	g_frameRing.beginFrame(g_backBufferIndex);
+
+	// Release whatever the GPU has finished with.
+	g_deferredRelease.collect(g_frameRing.completedValue());
+	g_heapManager.collect(g_frameRing.completedValue());
 }
 
 void present()
 {
 	// Transition the render target to the state that allows it to be presented to the display.
-	//D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(g_renderTargets[g_backBufferIndex].get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
-	//g_commandList->ResourceBarrier(1, &barrier);
-	D3D12_RESOURCE_BARRIER barriers[] =
-	{
-		CD3DX12_RESOURCE_BARRIER::Transition(g_renderTexture.get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET),
-		CD3DX12_RESOURCE_BARRIER::Transition(g_renderTargets[g_backBufferIndex].get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT)
-	};
-	g_commandList->ResourceBarrier(2, barriers);
+	D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(g_renderTargets[g_backBufferIndex].get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
+	g_commandList->ResourceBarrier(1, &barrier);
 
 	// Send the command list off to the GPU for processing.
 	winrt::check_hresult(g_commandList->Close());
@@ -670,8 +681,8 @@ void present()
 
 	// The first argument instructs DXGI to block until VSync, putting the application
 	// to sleep until the next VSync. This ensures we don't waste any cycles rendering
-	// frames that will never be displayed to the screen.
-	HRESULT hr = g_swapChain->Present(1, 0);
+	// frames that will never be displayed to the screen. Headless runs skip presentation.
+	HRESULT hr = gHeadless ? S_OK : g_swapChain->Present(1, 0);
 
 	// If the device was reset we must completely reinitialize the renderer.
 	if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
@@ -688,7 +699,7 @@ void present()
 
 bool init()
 {
-	g_window = glfwGetWin32Window(g_pWindow);
+	g_window = g_pWindow ? glfwGetWin32Window(g_pWindow) : nullptr;
 	createDevice();
 	createResources();
 
@@ -719,11 +730,16 @@ void update()
 
 void draw()
 {
-	winrt::check_hresult(g_commandAllocators[g_backBufferIndex]->Reset());
-	winrt::check_hresult(g_commandList->Reset(g_commandAllocators[g_backBufferIndex].get(), nullptr));
+	FrameContext& frame = g_frameRing.current();
+	winrt::check_hresult(frame.commandAllocator->Reset());
+	winrt::check_hresult(g_commandList->Reset(frame.commandAllocator.get(), nullptr));
+	g_shaderDescriptors.beginFrame(g_frameRing.frameIndex());
+
+	// Offscreen pass, the render texture takes over its aliased memory here.
+	g_transients.activate(g_commandList.get(), g_renderTexture);
 
 	// Clear the views.
-	CD3DX12_CPU_DESCRIPTOR_HANDLE renderDescriptor(g_renderDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+	CD3DX12_CPU_DESCRIPTOR_HANDLE renderDescriptor(g_renderTextureRtv.cpu);
 	g_commandList->OMSetRenderTargets(1, &renderDescriptor, FALSE, nullptr);
 	float clearColor[] = { 0.0f, 0.2f, 0.3f, 1.0f };
 	g_commandList->ClearRenderTargetView(renderDescriptor, clearColor, 0, nullptr);
@@ -740,14 +756,11 @@ void draw()
 	g_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	g_commandList->DrawInstanced(3, 1, 0, 0);
 
-	D3D12_RESOURCE_BARRIER barriers[] =
-	{
-		CD3DX12_RESOURCE_BARRIER::Transition(g_renderTexture.get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
-		CD3DX12_RESOURCE_BARRIER::Transition(g_renderTargets[g_backBufferIndex].get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET)
-	};
-	//D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(g_renderTargets[g_backBufferIndex].get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
-	//g_commandList->ResourceBarrier(1, &barrier);
-	g_commandList->ResourceBarrier(2, barriers);
+	// Composite pass
+	g_transients.transition(g_commandList.get(), g_renderTexture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+	D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(g_renderTargets[g_backBufferIndex].get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	g_commandList->ResourceBarrier(1, &barrier);
 
 	// Clear the views.
 	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvDescriptor
@@ -768,32 +781,77 @@ void draw()
 	g_commandList->SetPipelineState(g_renderPipeline.get());
 	g_commandList->SetGraphicsRootSignature(g_renderRootSignature.get());
 
-	ID3D12DescriptorHeap* ppHeaps[] = { g_srvDescriptorHeap.get() };
+	ID3D12DescriptorHeap* ppHeaps[] = { g_shaderDescriptors.heap() };
 	g_commandList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
 
-	g_commandList->SetGraphicsRootDescriptorTable(0, g_srvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	g_commandList->SetGraphicsRootDescriptorTable(0, g_shaderDescriptors.stageTable(&g_renderTextureSrv, 1));
 
 	g_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	g_commandList->DrawInstanced(3, 1, 0, 0);
 
+	// Inset pass, the render texture is dead and the inset texture takes over its memory.
+	g_transients.activate(g_commandList.get(), g_insetTexture);
+
+	const D3D12_RESOURCE_DESC insetTextureDesc = g_transients.resource(g_insetTexture)->GetDesc();
+	D3D12_VIEWPORT insetViewport = { 0.0f, 0.0f, static_cast<float>(insetTextureDesc.Width), static_cast<float>(insetTextureDesc.Height), D3D12_MIN_DEPTH, D3D12_MAX_DEPTH };
+	D3D12_RECT insetScissorRect = { 0, 0, static_cast<LONG>(insetTextureDesc.Width), static_cast<LONG>(insetTextureDesc.Height) };
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE insetDescriptor(g_insetTextureRtv.cpu);
+	g_commandList->OMSetRenderTargets(1, &insetDescriptor, FALSE, nullptr);
+	float insetClearColor[] = { 0.3f, 0.2f, 0.0f, 1.0f };
+	g_commandList->ClearRenderTargetView(insetDescriptor, insetClearColor, 0, nullptr);
+	g_commandList->RSSetViewports(1, &insetViewport);
+	g_commandList->RSSetScissorRects(1, &insetScissorRect);
+
+	g_commandList->SetPipelineState(g_pipeline.get());
+	g_commandList->SetGraphicsRootSignature(g_rootSignature.get());
+	g_commandList->IASetVertexBuffers(0, 1, &g_vertexBufferView);
+	g_commandList->DrawInstanced(3, 1, 0, 0);
+
+	// Inset composite pass, into the top right quarter of the back buffer.
+	g_transients.transition(g_commandList.get(), g_insetTexture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+	g_commandList->OMSetRenderTargets(1, &rtvDescriptor, FALSE, &dsvDescriptor);
+	insetViewport.TopLeftX = static_cast<float>(gWidth) - insetViewport.Width;
+	insetScissorRect.left = static_cast<LONG>(gWidth) - insetScissorRect.right;
+	insetScissorRect.right = static_cast<LONG>(gWidth);
+	g_commandList->RSSetViewports(1, &insetViewport);
+	g_commandList->RSSetScissorRects(1, &insetScissorRect);
+
+	g_commandList->SetPipelineState(g_renderPipeline.get());
+	g_commandList->SetGraphicsRootSignature(g_renderRootSignature.get());
+	g_commandList->SetGraphicsRootDescriptorTable(0, g_shaderDescriptors.stageTable(&g_insetTextureSrv, 1));
+	g_commandList->DrawInstanced(3, 1, 0, 0);
+
 	present();
 }
 
-int main()
+int main(int argc, char** argv)
 {
-	return run();
+	return run(argc, argv);
 }
 
 void onDeviceLost()
 {
+	// The device is gone, nothing retired on it needs to wait.
+	g_deferredRelease.flush();
+	g_rootSignatures.destroy();
+	g_pipelineBuilder.destroy();
+	g_pipelineCache.destroy();
+	g_transients.destroy();
+	g_shaderDescriptors.destroy();
+	g_stagingDescriptors.destroy();
+	g_stagingRtvs.destroy();
+	g_heapManager.destroy();
+	g_frameRing.destroy();
 	for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		g_commandAllocators[i] = nullptr;
 		g_renderTargets[i] = nullptr;
 	}
 
 	g_depthStencil = nullptr;
-	g_fence = nullptr;
+	g_depthStencilAllocation = {};
+	g_vertexBuffer = {};
 	g_commandList = nullptr;
 	g_swapChain = nullptr;
 	g_rtvDescriptorHeap = nullptr;
@@ -22,86 +22,18 @@
 #include <DirectXColors.h>
 
 #include "d3dx12.h"
-
-const int MAX_FRAMES_IN_FLIGHT = 2;
-
-const char* computeShaderSource = R"(
-static const uint3 gl_WorkGroupSize = uint3(1u, 1u, 1u);
-
-StructuredBuffer<float4> _34 : register(t0);
-RWStructuredBuffer<float4> _48 : register(u0);
-
-static uint3 gl_GlobalInvocationID;
-struct SPIRV_Cross_Input
-{
-	uint3 gl_GlobalInvocationID : SV_DispatchThreadID;
-};
-
-void comp_main()
-{
-	uint idx = (gl_GlobalInvocationID.y * 3 * gl_WorkGroupSize.x) + gl_GlobalInvocationID.x;
-	float3 p = _34[idx].xyz;
-	_48[idx] = float4(p.x + 0.001000000047497451305389404296875f, p.y, 0.0f, 1.0f);
-}
-
-[numthreads(1, 1, 1)]
-void main(SPIRV_Cross_Input stage_input)
-{
-	gl_GlobalInvocationID = stage_input.gl_GlobalInvocationID;
-	comp_main();
-}
-)";
-
-const char* vertexShaderSource = R"(
-static float4 gl_Position;
-static float4 aPos;
-
-struct SPIRV_Cross_Input
-{
-	float4 aPos : POSITION0;
-};
-
-struct SPIRV_Cross_Output
-{
-	float4 gl_Position : SV_Position;
-};
-
-void vert_main()
-{
-	gl_Position = float4(aPos.xy, 0.0f, 1.0f);
-}
-
-SPIRV_Cross_Output main(SPIRV_Cross_Input stage_input)
-{
-	aPos = stage_input.aPos;
-	vert_main();
-	SPIRV_Cross_Output stage_output;
-	stage_output.gl_Position = gl_Position;
-	return stage_output;
-}
-)";
-
-const char* fragmentShaderSource = R"(
-static float4 FragColor;
-
-struct SPIRV_Cross_Output
-{
-	float4 FragColor : SV_Target0;
-};
-
-void frag_main()
-{
-	FragColor = float4(1.0f, 0.0f, 0.0f, 1.0f);
-}
-
-SPIRV_Cross_Output main()
-{
-	frag_main();
-	SPIRV_Cross_Output stage_output;
-	stage_output.FragColor = FragColor;
-	return stage_output;
-}
-)";
+#include "frame_ring.h"
+#include "deferred_release.h"
+#include "heap_allocator.h"
+#include "upload_ring.h"
+#include "descriptor_allocator.h"
+#include "view_cache.h"
+#include "root_signature_cache.h"
+#include "shader_cache.h"
+#include "pipeline_cache.h"
+#include "pipeline_builder.h"
+#include "shader_hot_reload.h"
+#include "state_filter.h"
 
 HWND g_window;
 
@@ -112,21 +44,27 @@ winrt::com_ptr<ID3D12CommandQueue>			g_commandQueue;
 winrt::com_ptr<ID3D12DescriptorHeap>		g_rtvDescriptorHeap;
 winrt::com_ptr<ID3D12DescriptorHeap>		g_dsvDescriptorHeap;
 
-winrt::com_ptr<ID3D12CommandAllocator>		g_commandAllocators[MAX_FRAMES_IN_FLIGHT];
 winrt::com_ptr<ID3D12GraphicsCommandList>   g_commandList;
 
 // Rendering resources
 winrt::com_ptr<IDXGISwapChain3>				g_swapChain;
 winrt::com_ptr<ID3D12Resource>				g_renderTargets[MAX_FRAMES_IN_FLIGHT];
 winrt::com_ptr<ID3D12Resource>				g_depthStencil;
-
-winrt::com_ptr<ID3D12Fence>					g_fence;
-UINT64                                      g_fenceValues[MAX_FRAMES_IN_FLIGHT];
-winrt::handle								g_fenceEvent;
+HeapAllocation								g_depthStencilAllocation;
+
+FrameRing									g_frameRing;
+DeferredReleaseQueue						g_deferredRelease;
+HeapManager									g_heapManager;
+RootSignatureCache							g_rootSignatures;
+ShaderCache									g_shaderCache;
+PipelineCache								g_pipelineCache;
+PipelineBuilder								g_pipelineBuilder;
+ShaderHotReload								g_shaderReload;
+UploadRing									g_uploadRing;
 
 // Triangle
 winrt::com_ptr<ID3D12RootSignature>			g_rootSignature;
-winrt::com_ptr<ID3D12PipelineState>			g_pipeline;
+PendingPipeline								g_pipeline;
 //winrt::com_ptr<ID3D12Resource>			g_vertexBuffer;
 //D3D12_VERTEX_BUFFER_VIEW					g_vertexBufferView;
 
@@ -137,14 +75,15 @@ UINT g_backBufferIndex = 0;
 
 // Compute
 winrt::com_ptr<ID3D12RootSignature>			g_computeRootSignature;
-winrt::com_ptr<ID3D12PipelineState>			g_computePipeline;
+PendingPipeline								g_computePipeline;
 winrt::com_ptr<ID3D12Resource>				g_computeBuffer0;
 winrt::com_ptr<ID3D12Resource>				g_computeBuffer1;
-winrt::com_ptr<ID3D12Resource>				g_computeBufferUpload0;
-winrt::com_ptr<ID3D12Resource>				g_computeBufferUpload1;
 
-winrt::com_ptr<ID3D12DescriptorHeap>		g_srvUavHeap;
-UINT										g_srvUavDescriptorSize;
+StagingDescriptorHeap						g_stagingDescriptors;
+ShaderVisibleDescriptorHeap					g_shaderDescriptors;
+ViewCache									g_viewCache;
+DescriptorHandle							g_computeSrvs[2];
+DescriptorHandle							g_computeUavs[2];
 
 int g_readBuferId = 0;
 
@@ -152,19 +91,7 @@ void onDeviceLost();
 
 void waitForGpu() noexcept
 {
-	if (g_commandQueue && g_fence && g_fenceEvent)
-	{
-		UINT64 fenceValue = g_fenceValues[g_backBufferIndex];
-		if (SUCCEEDED(g_commandQueue->Signal(g_fence.get(), fenceValue)))
-		{
-			if (SUCCEEDED(g_fence->SetEventOnCompletion(fenceValue, g_fenceEvent.get())))
-			{
-				WaitForSingleObjectEx(g_fenceEvent.get(), INFINITE, FALSE);
-
-				g_fenceValues[g_backBufferIndex]++;
-			}
-		}
-	}
+	g_frameRing.waitForGpu();
 }
 
 void createDevice()
@@ -192,13 +119,22 @@ void createDevice()
 	winrt::check_hresult(CreateDXGIFactory2(dxgiFactoryFlags, IID_IDXGIFactory4, g_factory.put_void()));
 
 	winrt::com_ptr<IDXGIAdapter1> adapter;
-	for (UINT adapterIndex = 0; DXGI_ERROR_NOT_FOUND != g_factory->EnumAdapters1(adapterIndex, adapter.put()); adapterIndex++)
+	if (gWarp)
+	{
+		// Software rasterizer, lets the samples run on machines without a GPU.
+		winrt::check_hresult(g_factory->EnumWarpAdapter(IID_IDXGIAdapter1, adapter.put_void()));
+		winrt::check_hresult(D3D12CreateDevice(adapter.get(), D3D_FEATURE_LEVEL_11_0, IID_ID3D12Device, g_device.put_void()));
+	}
+	else
 	{
-		DXGI_ADAPTER_DESC1 adapterDesc;
-		winrt::check_hresult(adapter->GetDesc1(&adapterDesc));
+		for (UINT adapterIndex = 0; DXGI_ERROR_NOT_FOUND != g_factory->EnumAdapters1(adapterIndex, adapter.put()); adapterIndex++)
+		{
+			DXGI_ADAPTER_DESC1 adapterDesc;
+			winrt::check_hresult(adapter->GetDesc1(&adapterDesc));
 
-		if (adapterDesc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) continue;
-		if (SUCCEEDED(D3D12CreateDevice(adapter.get(), D3D_FEATURE_LEVEL_11_0, IID_ID3D12Device, g_device.put_void()))) break;
+			if (adapterDesc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) continue;
+			if (SUCCEEDED(D3D12CreateDevice(adapter.get(), D3D_FEATURE_LEVEL_11_0, IID_ID3D12Device, g_device.put_void()))) break;
+		}
 	}
 
 	/*
@@ -214,9 +150,8 @@ void createDevice()
 	CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc;
 	rootSignatureDesc.Init(0, nullptr, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
-	winrt::com_ptr<ID3DBlob> signature;
-	winrt::check_hresult(D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, signature.put(), nullptr));
-	winrt::check_hresult(g_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_ID3D12RootSignature, g_rootSignature.put_void()));
+	g_rootSignatures.create(g_device.get());
+	g_rootSignature.copy_from(g_rootSignatures.get(rootSignatureDesc));
 
 	// Compute root signature
 	{
@@ -231,15 +166,9 @@ void createDevice()
 		CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
 		rootSignatureDesc.Init_1_1(_countof(parameters), parameters, 0, nullptr);
 
-		winrt::com_ptr<ID3DBlob> signature;
-		winrt::check_hresult(D3DX12SerializeVersionedRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1_1, signature.put(), nullptr));
-		winrt::check_hresult(g_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_ID3D12RootSignature, g_computeRootSignature.put_void()));
+		g_computeRootSignature.copy_from(g_rootSignatures.get(rootSignatureDesc));
 	}
 
-	// Graphics pipeline
-	//std::vector<char> vertexShader;
-	//std::vector<char> pixelShader;
-
 #if defined(_DEBUG)
 	// Enable better shader debugging with the graphics debugging tools.
 	UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
@@ -247,71 +176,49 @@ void createDevice()
 	UINT compileFlags = 0;
 #endif
 
-	winrt::com_ptr<ID3DBlob> vertexShader;
-	winrt::com_ptr<ID3DBlob> pixelShader;
-	winrt::com_ptr<ID3DBlob> shaderError;
-	winrt::check_hresult(D3DCompile(vertexShaderSource, std::strlen(vertexShaderSource), nullptr, nullptr, nullptr, "main", "vs_5_0", compileFlags, 0, vertexShader.put(), nullptr));
-	winrt::check_hresult(D3DCompile(fragmentShaderSource, std::strlen(fragmentShaderSource), nullptr, nullptr, nullptr, "main", "ps_5_0", compileFlags, 0, pixelShader.put(), nullptr));
+	g_shaderCache.create();
+	g_pipelineCache.create(g_device.get(), g_factory.get(), "cache/learn_dx_07.pipelines");
+	g_pipelineBuilder.create(g_device.get(), &g_pipelineCache);
 
-	/*
-	{
-		std::ifstream ifs("data/basic_triangle.vert.cso", std::ios::binary | std::ios::ate);
-		std::streamsize size = ifs.tellg();
-		ifs.seekg(0, std::ios::beg);
+	// Shaders are read from the source tree and watched, saving one rebuilds its pipeline in the background.
+	g_shaderReload.create(LEARN_DX_SHADER_DIR "/learn_dx_07");
 
-		vertexShader.resize(size);
-		if (ifs.read(vertexShader.data(), size))
-		{
-		}
-		ifs.close();
-	}
+	// Graphics pipeline
+	g_shaderReload.add(&g_pipeline, { "triangle.vs.hlsl", "triangle.ps.hlsl" }, [compileFlags]()
 	{
-		std::ifstream ifs("data/basic_triangle.frag.cso", std::ios::binary | std::ios::ate);
-		std::streamsize size = ifs.tellg();
-		ifs.seekg(0, std::ios::beg);
-
-		pixelShader.resize(size);
-		if (ifs.read(pixelShader.data(), size))
+		// Define the vertex input layout.
+		D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
 		{
-		}
-		ifs.close();
-	}
-	*/
-
-	// Define the vertex input layout.
-	D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
-	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
-	};
-	// Describe and create the graphics pipeline state object (PSO).
-	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-	psoDesc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
-	psoDesc.pRootSignature = g_rootSignature.get();
-	//psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader.data(), vertexShader.size());
-	//psoDesc.PS = CD3DX12_SHADER_BYTECODE(pixelShader.data(), pixelShader.size());
-	psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader.get());
-	psoDesc.PS = CD3DX12_SHADER_BYTECODE(pixelShader.get());
-	psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
-	psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
-	psoDesc.DepthStencilState.DepthEnable = FALSE;
-	psoDesc.DepthStencilState.StencilEnable = FALSE;
-	psoDesc.SampleMask = UINT_MAX;
-	psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-	psoDesc.NumRenderTargets = 1;
-	psoDesc.RTVFormats[0] = DXGI_FORMAT_B8G8R8A8_UNORM;
-	psoDesc.SampleDesc.Count = 1;
-	winrt::check_hresult(g_device->CreateGraphicsPipelineState(&psoDesc, IID_ID3D12PipelineState, g_pipeline.put_void()));
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+		};
+		// Describe and create the graphics pipeline state object (PSO).
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
+		psoDesc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
+		psoDesc.pRootSignature = g_rootSignature.get();
+		psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+		psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+		psoDesc.DepthStencilState.DepthEnable = FALSE;
+		psoDesc.DepthStencilState.StencilEnable = FALSE;
+		psoDesc.SampleMask = UINT_MAX;
+		psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+		psoDesc.NumRenderTargets = 1;
+		psoDesc.RTVFormats[0] = DXGI_FORMAT_B8G8R8A8_UNORM;
+		psoDesc.SampleDesc.Count = 1;
+
+		return g_pipelineBuilder.build(psoDesc,
+			g_shaderCache.request(g_shaderReload.source("triangle.vs.hlsl").c_str(), "main", "vs_5_0", compileFlags),
+			g_shaderCache.request(g_shaderReload.source("triangle.ps.hlsl").c_str(), "main", "ps_5_0", compileFlags));
+	});
 
 	// Compute pipeline
+	g_shaderReload.add(&g_computePipeline, { "compute.cs.hlsl" }, [compileFlags]()
 	{
-		winrt::com_ptr<ID3DBlob> computeShader;
-		winrt::check_hresult(D3DCompile(computeShaderSource, std::strlen(computeShaderSource), nullptr, nullptr, nullptr, "main", "cs_5_0", compileFlags, 0, computeShader.put(), nullptr));
 		D3D12_COMPUTE_PIPELINE_STATE_DESC computePipelineStateDesc{};
 		computePipelineStateDesc.pRootSignature = g_computeRootSignature.get();
-		computePipelineStateDesc.CS = CD3DX12_SHADER_BYTECODE(computeShader.get());
 
-		winrt::check_hresult(g_device->CreateComputePipelineState(&computePipelineStateDesc, IID_ID3D12PipelineState, g_computePipeline.put_void()));
-	}
+		return g_pipelineBuilder.build(computePipelineStateDesc,
+			g_shaderCache.request(g_shaderReload.source("compute.cs.hlsl").c_str(), "main", "cs_5_0", compileFlags));
+	});
 
 	// Create the command queue.
 #if defined(_DEBUG)
@@ -350,24 +257,22 @@ void createDevice()
 	winrt::check_hresult(g_device->CreateDescriptorHeap(&dsvDescriptorHeapDesc, IID_ID3D12DescriptorHeap, g_dsvDescriptorHeap.put_void()));
 
 	g_rtvDescriptorSize = g_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-	g_srvUavDescriptorSize = g_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
-	for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-	{
-		winrt::check_hresult(g_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_ID3D12CommandAllocator, g_commandAllocators[i].put_void()));
-	}
+	// Frame ring (command allocators and fence timeline)
+	g_frameRing.create(g_device.get(), g_commandQueue.get(), static_cast<UINT>(gFramesInFlight));
+	g_uploadRing.create(g_device.get(), &g_frameRing);
 
-	// Describe and create a shader resource view (SRV) and unordered
-	// access view (UAV) descriptor heap.
-	D3D12_DESCRIPTOR_HEAP_DESC srvUavHeapDesc = {};
-	srvUavHeapDesc.NumDescriptors = 4;
-	srvUavHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	srvUavHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	winrt::check_hresult(g_device->CreateDescriptorHeap(&srvUavHeapDesc, IID_ID3D12DescriptorHeap, g_srvUavHeap.put_void()));
+	// Views live in a CPU-only staging heap and are copied into the shader-visible heap per frame.
+	g_stagingDescriptors.create(g_device.get(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	g_viewCache.create(g_device.get(), &g_stagingDescriptors, &g_deferredRelease);
+	g_shaderDescriptors.create(g_device.get(), g_frameRing.frameCount());
 
-	winrt::check_hresult(g_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, g_commandAllocators[0].get(), nullptr, IID_ID3D12CommandList, g_commandList.put_void()));
+	winrt::check_hresult(g_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, g_frameRing.frame(0).commandAllocator.get(), nullptr, IID_ID3D12CommandList, g_commandList.put_void()));
 	//winrt::check_hresult(g_commandList->Close());
 
+	// Buffers and textures are placed in shared heap blocks.
+	g_heapManager.create(g_device.get());
+
 	// Triangle
 	float triangleVertices[] =
 	{
@@ -404,49 +309,17 @@ void createDevice()
 
 	// Compute buffer
 	{
-		winrt::check_hresult(g_device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
-			D3D12_RESOURCE_STATE_COPY_DEST,
-			nullptr,
-			IID_ID3D12Resource,
-			g_computeBuffer0.put_void()));
-
-		winrt::check_hresult(g_device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
-			D3D12_RESOURCE_STATE_COPY_DEST,
-			nullptr,
-			IID_ID3D12Resource,
-			g_computeBuffer1.put_void()));
-
-		winrt::check_hresult(g_device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_ID3D12Resource,
-			g_computeBufferUpload0.put_void()));
-
-		winrt::check_hresult(g_device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_ID3D12Resource,
-			g_computeBufferUpload1.put_void()));
+		// Both live as long as the device, their heap ranges go with the heap manager.
+		const D3D12_RESOURCE_DESC computeBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+		g_computeBuffer0 = g_heapManager.createResource(computeBufferDesc, D3D12_RESOURCE_STATE_COPY_DEST).resource;
+		g_computeBuffer1 = g_heapManager.createResource(computeBufferDesc, D3D12_RESOURCE_STATE_COPY_DEST).resource;
 
-		D3D12_SUBRESOURCE_DATA particleData{};
-		particleData.pData = triangleVertices;
-		particleData.RowPitch = vertexBufferSize;
-		particleData.SlicePitch = particleData.RowPitch;
+		// Both buffers start from the same particle data, stage it once.
+		UploadAllocation particleUpload = g_uploadRing.allocate(vertexBufferSize, 16);
+		memcpy(particleUpload.cpuAddress, triangleVertices, vertexBufferSize);
 
-		UpdateSubresources<1>(g_commandList.get(), g_computeBuffer0.get(), g_computeBufferUpload0.get(), 0, 0, 1, &particleData);
-		UpdateSubresources<1>(g_commandList.get(), g_computeBuffer1.get(), g_computeBufferUpload1.get(), 0, 0, 1, &particleData);
+		g_commandList->CopyBufferRegion(g_computeBuffer0.get(), 0, particleUpload.resource, particleUpload.offset, vertexBufferSize);
+		g_commandList->CopyBufferRegion(g_computeBuffer1.get(), 0, particleUpload.resource, particleUpload.offset, vertexBufferSize);
 		g_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(g_computeBuffer0.get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
 		g_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(g_computeBuffer1.get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
 		//g_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(g_computeBuffer0.get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER));
@@ -457,7 +330,10 @@ void createDevice()
 		ID3D12CommandList* ppCommandLists[] = { g_commandList.get() };
 		g_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
 
-		// Resource view desc
+		// The setup list used the first frame slot, its upload memory is free once it has executed.
+		g_uploadRing.retire(g_frameRing.endFrame());
+
+		// Resource views, one SRV and one UAV per buffer for the ping-pong in draw().
 		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
@@ -467,11 +343,6 @@ void createDevice()
 		srvDesc.Buffer.StructureByteStride = 4 * sizeof(float);
 		srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
 
-		CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle0(g_srvUavHeap->GetCPUDescriptorHandleForHeapStart(), 2, g_srvUavDescriptorSize);
-		CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle1(g_srvUavHeap->GetCPUDescriptorHandleForHeapStart(), 3, g_srvUavDescriptorSize);
-		g_device->CreateShaderResourceView(g_computeBuffer0.get(), &srvDesc, srvHandle0);
-		g_device->CreateShaderResourceView(g_computeBuffer1.get(), &srvDesc, srvHandle1);
-
 		D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
 		uavDesc.Format = DXGI_FORMAT_UNKNOWN;
 		uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
@@ -481,32 +352,29 @@ void createDevice()
 		uavDesc.Buffer.CounterOffsetInBytes = 0;
 		uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
 
-		CD3DX12_CPU_DESCRIPTOR_HANDLE uavHandle0(g_srvUavHeap->GetCPUDescriptorHandleForHeapStart(), 0, g_srvUavDescriptorSize);
-		CD3DX12_CPU_DESCRIPTOR_HANDLE uavHandle1(g_srvUavHeap->GetCPUDescriptorHandleForHeapStart(), 1, g_srvUavDescriptorSize);
-		g_device->CreateUnorderedAccessView(g_computeBuffer0.get(), nullptr, &uavDesc, uavHandle0);
-		g_device->CreateUnorderedAccessView(g_computeBuffer1.get(), nullptr, &uavDesc, uavHandle1);
-	}
-
-	// Fence
-	winrt::check_hresult(g_device->CreateFence(g_fenceValues[g_backBufferIndex], D3D12_FENCE_FLAG_NONE, IID_ID3D12Fence, g_fence.put_void()));
-	g_fenceValues[g_backBufferIndex]++;
-
-	g_fenceEvent.attach(CreateEventEx(nullptr, nullptr, 0, EVENT_MODIFY_STATE | SYNCHRONIZE));
-	if (!g_fenceEvent)
-	{
-		throw std::system_error(std::error_code(static_cast<int>(GetLastError()), std::system_category()), "CreateEventEx");
+		g_computeSrvs[0] = g_viewCache.srv(g_computeBuffer0.get(), &srvDesc);
+		g_computeSrvs[1] = g_viewCache.srv(g_computeBuffer1.get(), &srvDesc);
+		g_computeUavs[0] = g_viewCache.uav(g_computeBuffer0.get(), nullptr, &uavDesc);
+		g_computeUavs[1] = g_viewCache.uav(g_computeBuffer1.get(), nullptr, &uavDesc);
 	}
 }
 
 void createResources()
 {
-	// Wait until all previous GPU work is complete.
-	waitForGpu();
+	// Back buffers can only be resized once the GPU is done with them,
+	// everything else goes through the deferred release queue.
+	if (g_swapChain)
+	{
+		waitForGpu();
+	}
 
 	for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
+		if (gHeadless)
+		{
+			g_deferredRelease.retire(g_renderTargets[i], g_frameRing.pendingValue());
+		}
 		g_renderTargets[i] = nullptr;
-		g_fenceValues[i] = g_fenceValues[g_backBufferIndex];
 	}
 
 	const DXGI_FORMAT backBufferFormat = DXGI_FORMAT_B8G8R8A8_UNORM;
@@ -514,9 +382,29 @@ void createResources()
 	const UINT backBufferWidth = static_cast<UINT>(gWidth);
 	const UINT backBufferHeight = static_cast<UINT>(gHeight);
 
-	if (g_swapChain)
+	if (gHeadless)
+	{
+		// Offscreen targets stand in for the swap chain. They start in PRESENT (COMMON)
+		// so the barriers in draw() stay the same.
+		D3D12_RESOURCE_DESC renderTargetDesc = CD3DX12_RESOURCE_DESC::Tex2D(backBufferFormat, backBufferWidth, backBufferHeight, 1, 1);
+		renderTargetDesc.Flags |= D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+
+		for (UINT i = 0; i < g_frameRing.frameCount(); i++)
+		{
+			winrt::check_hresult(g_device->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+				D3D12_HEAP_FLAG_NONE,
+				&renderTargetDesc,
+				D3D12_RESOURCE_STATE_PRESENT,
+				&CD3DX12_CLEAR_VALUE(backBufferFormat, DirectX::Colors::CornflowerBlue),
+				IID_ID3D12Resource,
+				g_renderTargets[i].put_void()
+			));
+		}
+	}
+	else if (g_swapChain)
 	{
-		HRESULT hr = g_swapChain->ResizeBuffers(MAX_FRAMES_IN_FLIGHT, backBufferWidth, backBufferHeight, backBufferFormat, 0);
+		HRESULT hr = g_swapChain->ResizeBuffers(g_frameRing.frameCount(), backBufferWidth, backBufferHeight, backBufferFormat, 0);
 		if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
 		{
 			onDeviceLost();
@@ -534,7 +422,7 @@ void createResources()
 		swapChainDesc.Height = backBufferHeight;
 		swapChainDesc.Format = backBufferFormat;
 		swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-		swapChainDesc.BufferCount = MAX_FRAMES_IN_FLIGHT;
+		swapChainDesc.BufferCount = g_frameRing.frameCount();
 		swapChainDesc.SampleDesc.Count = 1;
 		swapChainDesc.SampleDesc.Quality = 0;
 		swapChainDesc.Scaling = DXGI_SCALING_STRETCH;
@@ -557,9 +445,12 @@ void createResources()
 		winrt::check_hresult(g_factory->MakeWindowAssociation(g_window, DXGI_MWA_NO_ALT_ENTER));
 	}
 
-	for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	for (UINT i = 0; i < g_frameRing.frameCount(); i++)
 	{
-		winrt::check_hresult(g_swapChain->GetBuffer(i, IID_ID3D12Resource, g_renderTargets[i].put_void()));
+		if (!gHeadless)
+		{
+			winrt::check_hresult(g_swapChain->GetBuffer(i, IID_ID3D12Resource, g_renderTargets[i].put_void()));
+		}
 
 		CD3DX12_CPU_DESCRIPTOR_HANDLE rtvDescriptor
 		(
@@ -570,9 +461,9 @@ void createResources()
 		g_device->CreateRenderTargetView(g_renderTargets[i].get(), nullptr, rtvDescriptor);
 	}
 
-	g_backBufferIndex = g_swapChain->GetCurrentBackBufferIndex();
+	g_backBufferIndex = gHeadless ? 0 : g_swapChain->GetCurrentBackBufferIndex();
+	g_frameRing.beginFrame(g_backBufferIndex);
 
-	CD3DX12_HEAP_PROPERTIES depthHeapProperties(D3D12_HEAP_TYPE_DEFAULT);
 	D3D12_RESOURCE_DESC depthStencilDesc = CD3DX12_RESOURCE_DESC::Tex2D(
 		depthBufferFormat,
 		backBufferWidth,
@@ -587,15 +478,12 @@ void createResources()
 	depthOptimizedClearValue.DepthStencil.Depth = 1.0f;
 	depthOptimizedClearValue.DepthStencil.Stencil = 0;
 
-	winrt::check_hresult(g_device->CreateCommittedResource(
-		&depthHeapProperties,
-		D3D12_HEAP_FLAG_NONE,
-		&depthStencilDesc,
-		D3D12_RESOURCE_STATE_DEPTH_WRITE,
-		&depthOptimizedClearValue,
-		IID_ID3D12Resource,
-		g_depthStencil.put_void()
-	));
+	g_deferredRelease.retire(g_depthStencil, g_frameRing.pendingValue());
+	g_heapManager.free(g_depthStencilAllocation, g_frameRing.pendingValue());
+
+	PlacedResource depthStencil = g_heapManager.createResource(depthStencilDesc, D3D12_RESOURCE_STATE_DEPTH_WRITE, &depthOptimizedClearValue);
+	g_depthStencil = depthStencil.resource;
+	g_depthStencilAllocation = depthStencil.allocation;
 
 	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
 	dsvDesc.Format = depthBufferFormat;
@@ -606,8 +494,10 @@ void createResources()
 
 void clear()
 {
-	winrt::check_hresult(g_commandAllocators[g_backBufferIndex]->Reset());
-	winrt::check_hresult(g_commandList->Reset(g_commandAllocators[g_backBufferIndex].get(), nullptr));
+	FrameContext& frame = g_frameRing.current();
+	winrt::check_hresult(frame.commandAllocator->Reset());
+	winrt::check_hresult(g_commandList->Reset(frame.commandAllocator.get(), nullptr));
+	g_shaderDescriptors.beginFrame(g_frameRing.frameIndex());
 
 	D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(g_renderTargets[g_backBufferIndex].get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
 	g_commandList->ResourceBarrier(1, &barrier);
@@ -633,22 +523,26 @@ void clear()
 
 void moveToNextFrame()
 {
-	// Schedule a Signal command in the queue.
-	const UINT64 currentFenceValue = g_fenceValues[g_backBufferIndex];
-	winrt::check_hresult(g_commandQueue->Signal(g_fence.get(), currentFenceValue));
+	// Schedule a Signal command in the queue and stamp the current slot with it.
+	g_uploadRing.retire(g_frameRing.endFrame());
 
 	// Update the back buffer index.
-	g_backBufferIndex = g_swapChain->GetCurrentBackBufferIndex();
-
-	// If the next frame is not ready to be rendered yet, wait until it is ready.
-	if (g_fence->GetCompletedValue() < g_fenceValues[g_backBufferIndex])
+	if (gHeadless)
 	{
-		winrt::check_hresult(g_fence->SetEventOnCompletion(g_fenceValues[g_backBufferIndex], g_fenceEvent.get()));
-		WaitForSingleObjectEx(g_fenceEvent.get(), INFINITE, FALSE);
+		g_backBufferIndex = (g_backBufferIndex + 1) % g_frameRing.frameCount();
+	}
+	else
+	{
+		g_backBufferIndex = g_swapChain->GetCurrentBackBufferIndex();
 	}
 
-	// Set the fence value for the next frame.
-	g_fenceValues[g_backBufferIndex] = currentFenceValue + 1;
+	// If the next frame is not ready to be rendered yet, wait until it is ready.
+	g_frameRing.beginFrame(g_backBufferIndex);
+
+	// Release whatever the GPU has finished with.
+	g_deferredRelease.collect(g_frameRing.completedValue());
+	g_heapManager.collect(g_frameRing.completedValue());
+	g_uploadRing.collect(g_frameRing.completedValue());
 }
 
 void present()
@@ -664,8 +558,8 @@ void present()
 
 	// The first argument instructs DXGI to block until VSync, putting the application
 	// to sleep until the next VSync. This ensures we don't waste any cycles rendering
-	// frames that will never be displayed to the screen.
-	HRESULT hr = g_swapChain->Present(1, 0);
+	// frames that will never be displayed to the screen. Headless runs skip presentation.
+	HRESULT hr = gHeadless ? S_OK : g_swapChain->Present(1, 0);
 
 	// If the device was reset we must completely reinitialize the renderer.
 	if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
@@ -682,7 +576,7 @@ void present()
 
 bool init()
 {
-	g_window = glfwGetWin32Window(g_pWindow);
+	g_window = g_pWindow ? glfwGetWin32Window(g_pWindow) : nullptr;
 	createDevice();
 	createResources();
 
@@ -713,41 +607,33 @@ void update()
 
 void draw()
 {
+	// Swap in pipelines whose shaders were edited, the old ones are released once this frame completes.
+	g_shaderReload.apply(g_deferredRelease, g_frameRing.pendingValue());
+
 	clear();
 
+	// The loop binds the same root signature, pipeline and heaps every iteration, only the first reaches the list.
+	StateFilter<> state(g_commandList.get());
+
 	for (size_t i=0; i<10; i++)
 	{
-		UINT srvIndex;
-		UINT uavIndex;
-		winrt::com_ptr<ID3D12Resource> uavResource;
-		if (g_readBuferId == 0)
-		{
-			srvIndex = 2U;
-			uavIndex = 1U;
-			uavResource = g_computeBuffer1;
-		}
-		else
-		{
-			srvIndex = 3U;
-			uavIndex = 0U;
-			uavResource = g_computeBuffer0;
-		}
-		g_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(uavResource.get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
-
-		g_commandList->SetComputeRootSignature(g_computeRootSignature.get());
-		g_commandList->SetPipelineState(g_computePipeline.get());
+		// Read from one buffer, write the other.
+		ID3D12Resource* uavResource = g_readBuferId == 0 ? g_computeBuffer1.get() : g_computeBuffer0.get();
+		const DescriptorHandle srv = g_computeSrvs[g_readBuferId];
+		const DescriptorHandle uav = g_computeUavs[1 - g_readBuferId];
+		g_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(uavResource, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
 
-		ID3D12DescriptorHeap* ppHeaps[] = { g_srvUavHeap.get() };
-		g_commandList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
+		state.SetComputeRootSignature(g_computeRootSignature.get());
+		state.SetPipelineState(g_computePipeline.get());
 
-		CD3DX12_GPU_DESCRIPTOR_HANDLE srvHandle(g_srvUavHeap->GetGPUDescriptorHandleForHeapStart(), srvIndex, g_srvUavDescriptorSize);
-		CD3DX12_GPU_DESCRIPTOR_HANDLE uavHandle(g_srvUavHeap->GetGPUDescriptorHandleForHeapStart(), uavIndex, g_srvUavDescriptorSize);
+		ID3D12DescriptorHeap* ppHeaps[] = { g_shaderDescriptors.heap() };
+		state.SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
 
-		g_commandList->SetComputeRootDescriptorTable(0, srvHandle);
-		g_commandList->SetComputeRootDescriptorTable(1, uavHandle);
+		state.SetComputeRootDescriptorTable(0, g_shaderDescriptors.stageTable(&srv, 1));
+		state.SetComputeRootDescriptorTable(1, g_shaderDescriptors.stageTable(&uav, 1));
 		g_commandList->Dispatch(3, 1, 1);
 
-		g_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(uavResource.get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+		g_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(uavResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
 		g_readBuferId = 1 - g_readBuferId;
 	}
 
@@ -763,14 +649,14 @@ void draw()
 		vertexBufferView.BufferLocation = g_computeBuffer1->GetGPUVirtualAddress();
 	}
 
-	g_commandList->SetPipelineState(g_pipeline.get());
-	g_commandList->SetGraphicsRootSignature(g_rootSignature.get());
+	state.SetPipelineState(g_pipeline.get());
+	state.SetGraphicsRootSignature(g_rootSignature.get());
 
 	vertexBufferView.StrideInBytes = 4 * sizeof(float);
 	vertexBufferView.SizeInBytes = 3 * 4 * sizeof(float);
-	g_commandList->IASetVertexBuffers(0, 1, &vertexBufferView);
+	state.IASetVertexBuffers(0, 1, &vertexBufferView);
 
-	g_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	state.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	g_commandList->DrawInstanced(3, 1, 0, 0);
 
 	if (g_readBuferId == 0)
@@ -785,21 +671,32 @@ void draw()
 	present();
 }
 
-int main()
+int main(int argc, char** argv)
 {
-	return run();
+	return run(argc, argv);
 }
 
 void onDeviceLost()
 {
+	// The device is gone, nothing retired on it needs to wait.
+	g_deferredRelease.flush();
+	g_rootSignatures.destroy();
+	g_shaderReload.destroy();
+	g_pipelineBuilder.destroy();
+	g_pipelineCache.destroy();
+	g_uploadRing.destroy();
+	g_shaderDescriptors.destroy();
+	g_viewCache.destroy();
+	g_stagingDescriptors.destroy();
+	g_heapManager.destroy();
+	g_frameRing.destroy();
 	for (UINT i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		g_commandAllocators[i] = nullptr;
 		g_renderTargets[i] = nullptr;
 	}
 
 	g_depthStencil = nullptr;
-	g_fence = nullptr;
+	g_depthStencilAllocation = {};
 	g_commandList = nullptr;
 	g_swapChain = nullptr;
 	g_rtvDescriptorHeap = nullptr;
@@ -0,0 +1,147 @@
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "pipeline_cache.h"
+
+#include "test.h"
+
+static AdapterIdentity identity()
+{
+	AdapterIdentity identity;
+	identity.vendorId = 0x10DE;
+	identity.deviceId = 0x2204;
+	identity.subSysId = 0x1234;
+	identity.revision = 1;
+	identity.driverVersion = 0x001F000F000F1234ULL;
+	return identity;
+}
+
+static bool holds(PipelineCacheFile& file, UINT64 key, const std::string& blob)
+{
+	const std::vector<char>* cached = file.find(key);
+	return cached && std::string(cached->begin(), cached->end()) == blob;
+}
+
+static std::vector<char> twoEntries()
+{
+	PipelineCacheFile file;
+	file.insert(1, "first", 5);
+	file.insert(2, "second blob", 11);
+	return file.serialize(identity());
+}
+
+static void roundTrip()
+{
+	const std::vector<char> bytes = twoEntries();
+
+	PipelineCacheFile file;
+	CHECK(file.parse(bytes, identity()));
+	CHECK(file.size() == 2);
+	CHECK(holds(file, 1, "first"));
+	CHECK(holds(file, 2, "second blob"));
+	CHECK(file.find(3) == nullptr);
+
+	// Everything was used, so all of it is written again. Record order follows the hash map.
+	CHECK(file.serialize(identity()).size() == bytes.size());
+}
+
+static void rejectsOtherAdapters()
+{
+	const std::vector<char> bytes = twoEntries();
+
+	AdapterIdentity newDriver = identity();
+	newDriver.driverVersion++;
+	PipelineCacheFile file;
+	CHECK(!file.parse(bytes, newDriver));
+	CHECK(file.size() == 0);
+
+	AdapterIdentity otherDevice = identity();
+	otherDevice.deviceId++;
+	CHECK(!file.parse(bytes, otherDevice));
+	CHECK(file.size() == 0);
+
+	std::vector<char> badMagic = bytes;
+	badMagic[0] = 'X';
+	CHECK(!file.parse(badMagic, identity()));
+	CHECK(file.size() == 0);
+}
+
+static void rejectsTruncatedFiles()
+{
+	const std::vector<char> bytes = twoEntries();
+	PipelineCacheFile file;
+
+	// Short by one byte of the last blob: nothing is kept, not even the complete first record.
+	std::vector<char> truncated(bytes.begin(), bytes.end() - 1);
+	CHECK(!file.parse(truncated, identity()));
+	CHECK(file.size() == 0);
+
+	// Cut inside a record header.
+	truncated.assign(bytes.begin(), bytes.end() - 11 - 4);
+	CHECK(!file.parse(truncated, identity()));
+	CHECK(file.size() == 0);
+
+	// Cut inside the file header.
+	truncated.assign(bytes.begin(), bytes.begin() + 10);
+	CHECK(!file.parse(truncated, identity()));
+	CHECK(file.size() == 0);
+
+	CHECK(!file.parse({}, identity()));
+}
+
+static void agesOutUnusedEntries()
+{
+	PipelineCacheFile file;
+	CHECK(file.parse(twoEntries(), identity()));
+	CHECK(!file.dirty());
+
+	// Only entry 2 is used this run and entry 3 is new, entry 1 is not written back.
+	CHECK(holds(file, 2, "second blob"));
+	CHECK(file.dirty());
+	file.insert(3, "third", 5);
+
+	PipelineCacheFile next;
+	CHECK(next.parse(file.serialize(identity()), identity()));
+	CHECK(next.size() == 2);
+	CHECK(next.find(1) == nullptr);
+	CHECK(holds(next, 2, "second blob"));
+	CHECK(holds(next, 3, "third"));
+
+	// An unused run writes an empty cache.
+	PipelineCacheFile unused;
+	CHECK(unused.parse(twoEntries(), identity()));
+	CHECK(next.parse(unused.serialize(identity()), identity()));
+	CHECK(next.size() == 0);
+}
+
+static void savesAndLoads()
+{
+	const std::filesystem::path directory = std::filesystem::temp_directory_path() / "learn_dx_pipeline_cache_test";
+	const std::string path = (directory / "pipelines.bin").string();
+	std::error_code error;
+	std::filesystem::remove_all(directory, error);
+
+	PipelineCacheFile file;
+	CHECK(!file.load(path, identity()));
+	file.insert(7, "blob", 4);
+	CHECK(file.save(path, identity()));
+	CHECK(!file.dirty());
+	CHECK(!std::filesystem::exists(path + ".tmp"));
+
+	PipelineCacheFile loaded;
+	CHECK(loaded.load(path, identity()));
+	CHECK(holds(loaded, 7, "blob"));
+
+	std::filesystem::remove_all(directory, error);
+}
+
+int main()
+{
+	roundTrip();
+	rejectsOtherAdapters();
+	rejectsTruncatedFiles();
+	agesOutUnusedEntries();
+	savesAndLoads();
+	return testResult();
+}
@@ -0,0 +1,152 @@
+#include <cstdint>
+#include <vector>
+
+#include "residency_manager.h"
+
+#include "test.h"
+
+// The manager only compares pointers, stand-in objects never need to exist.
+static ID3D12Pageable* fake(uintptr_t id)
+{
+	return reinterpret_cast<ID3D12Pageable*>(id);
+}
+
+static void evictsLeastRecentlyUsed()
+{
+	FakeMemoryBackend backend;
+	backend.setBudget(DXGI_MEMORY_SEGMENT_GROUP_LOCAL, 300);
+	ResidencyManager residency;
+	residency.create(&backend);
+
+	ID3D12Pageable* a = fake(1);
+	ID3D12Pageable* b = fake(2);
+	ID3D12Pageable* c = fake(3);
+	ID3D12Pageable* d = fake(4);
+	residency.track(a, 100, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory::Texture);
+	residency.track(b, 100, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory::Texture);
+	residency.track(c, 100, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory::Texture);
+
+	// Frame 1 uses everything, frame 2 only b and c and adds d.
+	residency.beginFrame(0);
+	residency.use(a, 1);
+	residency.use(b, 1);
+	residency.use(c, 1);
+	residency.beginFrame(1);
+	residency.use(b, 2);
+	residency.use(c, 2);
+	residency.track(d, 100, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory::Buffer);
+	CHECK(backend.evicted.empty());
+
+	// 400 bytes resident against 300, a is the least recently used.
+	residency.beginFrame(2);
+	CHECK(backend.evicted == std::vector<ID3D12Pageable*>({ a }));
+	CHECK(residency.stats().residentBytes == 300);
+	CHECK(residency.stats().totalBytes == 400);
+	CHECK(residency.stats().evictions == 1);
+	CHECK(residency.stats().evictedBytes == 100);
+
+	// Upload heaps are budgeted in the non-local group, which has no budget here.
+	residency.track(fake(5), 1000, D3D12_HEAP_TYPE_UPLOAD, MemoryCategory::Upload);
+	residency.beginFrame(2);
+	CHECK(backend.evicted.size() == 1);
+}
+
+static void keepsObjectsInFlight()
+{
+	FakeMemoryBackend backend;
+	ResidencyManager residency;
+	residency.create(&backend);
+
+	ID3D12Pageable* a = fake(1);
+	ID3D12Pageable* b = fake(2);
+	residency.track(a, 100, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory::Texture);
+	residency.track(b, 100, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory::Texture);
+
+	residency.beginFrame(0);
+	residency.use(a, 1);
+	residency.use(b, 2);
+
+	// Fence 1 has completed but 2 has not, only a is a candidate.
+	backend.setBudget(DXGI_MEMORY_SEGMENT_GROUP_LOCAL, 100);
+	residency.beginFrame(1);
+	CHECK(backend.evicted == std::vector<ID3D12Pageable*>({ a }));
+	CHECK(residency.stats().residentBytes == 100);
+
+	// Once fence 2 completes b is the oldest, a was used more recently and stays.
+	residency.use(a, 3);
+	residency.beginFrame(3);
+	CHECK(backend.evicted.size() == 2 && backend.evicted[1] == b);
+}
+
+static void useMakesResident()
+{
+	FakeMemoryBackend backend;
+	ResidencyManager residency;
+	residency.create(&backend);
+
+	ID3D12Pageable* a = fake(1);
+	ID3D12Pageable* b = fake(2);
+	residency.track(a, 100, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory::RenderTarget);
+	residency.track(b, 100, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory::DepthStencil);
+	residency.beginFrame(0);
+	residency.use(b, 1);
+
+	// The budget shrinks, a has not been used since frame 0.
+	backend.setBudget(DXGI_MEMORY_SEGMENT_GROUP_LOCAL, 100);
+	residency.beginFrame(1);
+	CHECK(backend.evicted == std::vector<ID3D12Pageable*>({ a }));
+
+	// Resident objects are not paged in again, evicted ones are, once.
+	residency.use(b, 2);
+	CHECK(backend.madeResident.empty());
+	residency.use(a, 2);
+	residency.use(a, 2);
+	CHECK(backend.madeResident == std::vector<ID3D12Pageable*>({ a }));
+	CHECK(residency.stats().residentBytes == 200);
+
+	// Untracked objects are ignored.
+	residency.use(fake(3), 2);
+	CHECK(backend.madeResident.size() == 1);
+}
+
+static void tracksHighWaterMarks()
+{
+	FakeMemoryBackend backend;
+	ResidencyManager residency;
+	residency.create(&backend);
+
+	ID3D12Pageable* a = fake(1);
+	ID3D12Pageable* b = fake(2);
+	residency.track(a, 100, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory::RenderTarget);
+	residency.track(b, 50, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory::DepthStencil);
+	CHECK(residency.bytes(D3D12_HEAP_TYPE_DEFAULT, MemoryCategory::RenderTarget) == 100);
+	CHECK(residency.bytes(D3D12_HEAP_TYPE_DEFAULT, MemoryCategory::DepthStencil) == 50);
+	CHECK(residency.stats().frameHighWaterBytes == 150);
+	CHECK(residency.stats().highWaterBytes == 150);
+
+	// A new frame starts its peak from what is live now, the overall peak stays.
+	residency.untrack(b);
+	CHECK(residency.bytes(D3D12_HEAP_TYPE_DEFAULT, MemoryCategory::DepthStencil) == 0);
+	residency.beginFrame(0);
+	CHECK(residency.stats().frameHighWaterBytes == 100);
+	CHECK(residency.stats().highWaterBytes == 150);
+
+	// A transient peak within a frame is kept after it is released.
+	residency.track(fake(3), 200, D3D12_HEAP_TYPE_UPLOAD, MemoryCategory::Upload);
+	residency.untrack(fake(3));
+	CHECK(residency.stats().totalBytes == 100);
+	CHECK(residency.stats().frameHighWaterBytes == 300);
+	CHECK(residency.stats().highWaterBytes == 300);
+	residency.beginFrame(0);
+	CHECK(residency.stats().frameHighWaterBytes == 100);
+	CHECK(residency.stats().highWaterBytes == 300);
+}
+
+int main()
+{
+	evictsLeastRecentlyUsed();
+	keepsObjectsInFlight();
+	useMakesResident();
+	tracksHighWaterMarks();
+	return testResult();
+}
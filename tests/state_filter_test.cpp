@@ -0,0 +1,205 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "state_filter.h"
+
+#include "test.h"
+
+// The filter only compares pointers, stand-in objects never need to exist.
+template <typename T>
+T* fake(uintptr_t id)
+{
+	return reinterpret_cast<T*>(id);
+}
+
+static void pipelineRepeats()
+{
+	RecordingCommandList list;
+	StateFilter<RecordingCommandList> filter(&list);
+
+	filter.SetPipelineState(fake<ID3D12PipelineState>(1));
+	filter.SetPipelineState(fake<ID3D12PipelineState>(1));
+	filter.SetPipelineState(fake<ID3D12PipelineState>(2));
+	filter.SetPipelineState(fake<ID3D12PipelineState>(2));
+	filter.SetPipelineState(fake<ID3D12PipelineState>(1));
+
+	CHECK(list.calls == std::vector<std::string>({ "SetPipelineState(1)", "SetPipelineState(2)", "SetPipelineState(1)" }));
+	CHECK(filter.forwarded() == 3);
+	CHECK(filter.filtered() == 2);
+}
+
+static void rootSignatureRepeats()
+{
+	RecordingCommandList list;
+	StateFilter<RecordingCommandList> filter(&list);
+
+	filter.SetGraphicsRootSignature(fake<ID3D12RootSignature>(1));
+	filter.SetGraphicsRootSignature(fake<ID3D12RootSignature>(1));
+	// Graphics and compute bind independently.
+	filter.SetComputeRootSignature(fake<ID3D12RootSignature>(1));
+	filter.SetComputeRootSignature(fake<ID3D12RootSignature>(1));
+
+	CHECK(list.calls == std::vector<std::string>({ "SetGraphicsRootSignature(1)", "SetComputeRootSignature(1)" }));
+	CHECK(filter.forwarded() == 2);
+	CHECK(filter.filtered() == 2);
+}
+
+static void rootSignatureChangeInvalidatesArguments()
+{
+	RecordingCommandList list;
+	StateFilter<RecordingCommandList> filter(&list);
+
+	filter.SetGraphicsRootSignature(fake<ID3D12RootSignature>(1));
+	filter.SetGraphicsRootDescriptorTable(0, { 4096 });
+	filter.SetGraphicsRoot32BitConstant(1, 7, 0);
+	filter.SetGraphicsRootConstantBufferView(2, 65536);
+	filter.SetGraphicsRootDescriptorTable(0, { 4096 });
+	filter.SetGraphicsRoot32BitConstant(1, 7, 0);
+	filter.SetGraphicsRootConstantBufferView(2, 65536);
+	CHECK(filter.forwarded() == 4);
+	CHECK(filter.filtered() == 3);
+
+	// Rebinding the same root signature keeps the arguments, a different one drops all of them.
+	filter.SetGraphicsRootSignature(fake<ID3D12RootSignature>(1));
+	filter.SetGraphicsRootDescriptorTable(0, { 4096 });
+	CHECK(filter.forwarded() == 4);
+	CHECK(filter.filtered() == 5);
+
+	list.calls.clear();
+	filter.SetGraphicsRootSignature(fake<ID3D12RootSignature>(2));
+	filter.SetGraphicsRootDescriptorTable(0, { 4096 });
+	filter.SetGraphicsRoot32BitConstant(1, 7, 0);
+	filter.SetGraphicsRootConstantBufferView(2, 65536);
+
+	CHECK(list.calls == std::vector<std::string>({
+		"SetGraphicsRootSignature(2)",
+		"SetGraphicsRootDescriptorTable(0, 4096)",
+		"SetGraphicsRoot32BitConstant(1, 7, 0)",
+		"SetGraphicsRootConstantBufferView(2, 65536)"
+	}));
+	CHECK(filter.forwarded() == 8);
+	CHECK(filter.filtered() == 5);
+
+	// A compute root signature change leaves graphics arguments alone.
+	filter.SetComputeRootSignature(fake<ID3D12RootSignature>(3));
+	filter.SetGraphicsRootDescriptorTable(0, { 4096 });
+	CHECK(filter.forwarded() == 9);
+	CHECK(filter.filtered() == 6);
+}
+
+static void descriptorHeapRepeats()
+{
+	RecordingCommandList list;
+	StateFilter<RecordingCommandList> filter(&list);
+
+	ID3D12DescriptorHeap* heaps[] = { fake<ID3D12DescriptorHeap>(1), fake<ID3D12DescriptorHeap>(2) };
+	filter.SetDescriptorHeaps(2, heaps);
+	filter.SetDescriptorHeaps(2, heaps);
+	filter.SetDescriptorHeaps(1, heaps);
+
+	CHECK(list.calls == std::vector<std::string>({ "SetDescriptorHeaps(2, {1, 2})", "SetDescriptorHeaps(1, {1})" }));
+	CHECK(filter.forwarded() == 2);
+	CHECK(filter.filtered() == 1);
+}
+
+static void descriptorHeapChangeDropsTables()
+{
+	RecordingCommandList list;
+	StateFilter<RecordingCommandList> filter(&list);
+
+	ID3D12DescriptorHeap* heap = fake<ID3D12DescriptorHeap>(1);
+	filter.SetDescriptorHeaps(1, &heap);
+	filter.SetGraphicsRootSignature(fake<ID3D12RootSignature>(1));
+	filter.SetComputeRootSignature(fake<ID3D12RootSignature>(2));
+	filter.SetGraphicsRootDescriptorTable(0, { 4096 });
+	filter.SetComputeRootDescriptorTable(0, { 8192 });
+	filter.SetGraphicsRoot32BitConstant(1, 7, 0);
+	CHECK(filter.forwarded() == 6);
+	CHECK(filter.filtered() == 0);
+
+	// Same heap: tables survive.
+	filter.SetDescriptorHeaps(1, &heap);
+	filter.SetGraphicsRootDescriptorTable(0, { 4096 });
+	CHECK(filter.forwarded() == 6);
+	CHECK(filter.filtered() == 2);
+
+	// New heap: tables of both kinds are forwarded again, other root arguments are still filtered.
+	list.calls.clear();
+	heap = fake<ID3D12DescriptorHeap>(2);
+	filter.SetDescriptorHeaps(1, &heap);
+	filter.SetGraphicsRootDescriptorTable(0, { 4096 });
+	filter.SetComputeRootDescriptorTable(0, { 8192 });
+	filter.SetGraphicsRoot32BitConstant(1, 7, 0);
+
+	CHECK(list.calls == std::vector<std::string>({
+		"SetDescriptorHeaps(1, {2})",
+		"SetGraphicsRootDescriptorTable(0, 4096)",
+		"SetComputeRootDescriptorTable(0, 8192)"
+	}));
+	CHECK(filter.forwarded() == 9);
+	CHECK(filter.filtered() == 3);
+}
+
+static void vertexBufferRepeats()
+{
+	RecordingCommandList list;
+	StateFilter<RecordingCommandList> filter(&list);
+
+	D3D12_VERTEX_BUFFER_VIEW views[2] = { { 4096, 256, 16 }, { 8192, 128, 8 } };
+	filter.IASetVertexBuffers(0, 2, views);
+	filter.IASetVertexBuffers(0, 2, views);
+	// A subrange of what is bound is dropped too.
+	filter.IASetVertexBuffers(1, 1, &views[1]);
+	CHECK(filter.forwarded() == 1);
+	CHECK(filter.filtered() == 2);
+
+	// One slot differs, the whole call goes through.
+	views[1].SizeInBytes = 64;
+	filter.IASetVertexBuffers(0, 2, views);
+	// Slot 2 was never bound.
+	filter.IASetVertexBuffers(1, 2, views);
+
+	CHECK(list.calls == std::vector<std::string>({
+		"IASetVertexBuffers(0, 2, {{4096, 256, 16}, {8192, 128, 8}})",
+		"IASetVertexBuffers(0, 2, {{4096, 256, 16}, {8192, 64, 8}})",
+		"IASetVertexBuffers(1, 2, {{4096, 256, 16}, {8192, 64, 8}})"
+	}));
+	CHECK(filter.forwarded() == 3);
+	CHECK(filter.filtered() == 2);
+
+	// Unbinding with null views is always forwarded and forgets the slots.
+	filter.IASetVertexBuffers(0, 1, nullptr);
+	filter.IASetVertexBuffers(0, 1, views);
+	CHECK(list.calls.back() == "IASetVertexBuffers(0, 1, {{4096, 256, 16}})");
+	CHECK(filter.forwarded() == 5);
+	CHECK(filter.filtered() == 2);
+}
+
+static void resetForgetsEverything()
+{
+	RecordingCommandList list;
+	StateFilter<RecordingCommandList> filter(&list);
+
+	filter.SetPipelineState(fake<ID3D12PipelineState>(1));
+	filter.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	filter.reset(&list);
+	filter.SetPipelineState(fake<ID3D12PipelineState>(1));
+	filter.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	CHECK(list.calls.size() == 4);
+	CHECK(filter.forwarded() == 4);
+	CHECK(filter.filtered() == 0);
+}
+
+int main()
+{
+	pipelineRepeats();
+	rootSignatureRepeats();
+	rootSignatureChangeInvalidatesArguments();
+	descriptorHeapRepeats();
+	descriptorHeapChangeDropsTables();
+	vertexBufferRepeats();
+	resetForgetsEverything();
+	return testResult();
+}
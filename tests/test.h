@@ -0,0 +1,26 @@
+#ifndef TEST_H__
+#define TEST_H__
+
+#include <cstdio>
+
+// Minimal checks for the device-free tests, registered with add_test() in CMakeLists.txt.
+// A failed CHECK prints its location and the test keeps going, main() returns testResult().
+inline int g_testFailures = 0;
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			g_testFailures++; \
+		} \
+	} while (false)
+
+inline int testResult()
+{
+	if (g_testFailures) std::fprintf(stderr, "%d check(s) failed\n", g_testFailures);
+	return g_testFailures ? 1 : 0;
+}
+
+#endif // TEST_H__